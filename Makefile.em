@@ -7,11 +7,33 @@ MX_INCLUDE = -I$(LIBS_PATH)/mx2/include -I/usr/include/glm
 ZLIB_LIB = -s USE_ZLIB=1
 PNG_LIB = -s USE_LIBPNG=1
 LIBMX_LIB = $(LIBS_PATH)/mx2/lib/libmx.a 
-PRELOAD = --preload-file data
+# Copies listed in data/assets.txt (make assets) stay out of the bundle;
+# loading one by name reads the original.
+ASSET_COPIES = $(shell cut -d' ' -f1 data/assets.txt 2>/dev/null)
+PRELOAD = --preload-file data $(foreach f,$(ASSET_COPIES),--exclude-file data/$(f) --exclude-file data/$(f:.mxmod.z=.mxmb))
 SOURCES = graphics.cpp
 OBJECTS = $(SOURCES:.cpp=.o)
 OUTPUT = MX_app.html
 
+ifeq ($(STATS),1)
+CXXFLAGS += -DMX_FRAME_STATS
+endif
+
+ifeq ($(SHADER_PROFILE),1)
+CXXFLAGS += -DMX_SHADER_PROFILE
+endif
+
+# Reads models on a pthread; needs the COOP/COEP headers server.py sends.
+ifeq ($(THREADS),1)
+CXXFLAGS += -pthread
+THREAD_LIB = -s PTHREAD_POOL_SIZE=1
+endif
+
+# Frustum culling runs four meshes per wasm SIMD instruction.
+ifeq ($(SIMD),1)
+CXXFLAGS += -msimd128
+endif
+
 .PHONY: all clean install
 
 all: $(OUTPUT)
@@ -20,7 +42,7 @@ all: $(OUTPUT)
 	$(CXX) $(CXXFLAGS) $(MX_INCLUDE) $(ZLIB_INCLUDE) $(PNG_INCLUDE) -c $< -o $@
 
 $(OUTPUT): $(OBJECTS)
-	$(CXX) $(CXXFLAGS) $(OBJECTS) -o $(OUTPUT) $(PRELOAD)  -s USE_SDL=2 -s USE_LIBJPEG=1 -s USE_SDL_IMAGE=2 -s SDL2_IMAGE_FORMATS='["png","jpg"]' -s USE_SDL_TTF=2 $(LIBMX_LIB) $(PNG_LIB) $(ZLIB_LIB) -s ALLOW_MEMORY_GROWTH -s ASSERTIONS -s ENVIRONMENT=web -s USE_WEBGL2=1 -s FULL_ES3 -s USE_SDL_MIXER=2 -lembind -s EXPORTED_RUNTIME_METHODS=['HEAPU8'] -s EXPORTED_FUNCTIONS=['_malloc','_free','_main'] -s OFFSCREEN_FRAMEBUFFER=1
+	$(CXX) $(CXXFLAGS) $(OBJECTS) -o $(OUTPUT) $(PRELOAD)  -s USE_SDL=2 -s USE_LIBJPEG=1 -s USE_SDL_IMAGE=2 -s SDL2_IMAGE_FORMATS='["png","jpg"]' -s USE_SDL_TTF=2 $(LIBMX_LIB) $(PNG_LIB) $(ZLIB_LIB) -s ALLOW_MEMORY_GROWTH -s ASSERTIONS -s ENVIRONMENT=web -s USE_WEBGL2=1 -s FULL_ES3 -s USE_SDL_MIXER=2 -lembind -s EXPORTED_RUNTIME_METHODS=['HEAPU8'] -s EXPORTED_FUNCTIONS=['_malloc','_free','_main'] -s OFFSCREEN_FRAMEBUFFER=1 $(THREAD_LIB)
 
 clean:
 	rm -f *.o $(OUTPUT) *.wasm *.js *.data
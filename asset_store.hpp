@@ -0,0 +1,100 @@
+#ifndef __ASSET_STORE_HPP_
+#define __ASSET_STORE_HPP_
+
+#include"content_hash.hpp"
+#include<cstdint>
+#include<cstdio>
+#include<fstream>
+#include<string>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+// Files in the data directory keyed by content. data/assets.txt lists,
+// one "copy original" pair per line relative to data/, files that are
+// byte-for-byte copies of another: the web bundle leaves the copies out
+// and resolve() sends their names to the original. key() hashes a file
+// the first time it is asked for, so names that share bytes share a key
+// even without a manifest entry.
+class AssetStore {
+public:
+    bool loadManifest(const std::string &filename) {
+        std::ifstream file(filename);
+        if(!file.is_open()) return false;
+        std::string copy, original;
+        while(file >> copy >> original) aliases[copy] = original;
+        return true;
+    }
+
+    size_t aliasCount() const { return aliases.size(); }
+
+    bool isAlias(const std::string &relative) const { return aliases.count(relative) != 0; }
+
+    std::string resolve(const std::string &path) const {
+        size_t pos = path.rfind("data/");
+        if(pos == std::string::npos) return path;
+        auto it = aliases.find(path.substr(pos + 5));
+        return it == aliases.end() ? path : path.substr(0, pos + 5) + it->second;
+    }
+
+    // "#" and the hash of the file at path; the path itself if it cannot
+    // be read, so a missing file still gets a key of its own.
+    std::string key(const std::string &path) {
+        auto it = keys.find(path);
+        if(it != keys.end()) return it->second;
+        std::string bytes;
+        return remember(path, readFileBytes(path, bytes) ? fnv1a(bytes) : 0);
+    }
+
+    // The key of a path hashed before, or "" without touching the file.
+    std::string knownKey(const std::string &path) const {
+        auto it = keys.find(path);
+        return it == keys.end() ? std::string() : it->second;
+    }
+
+    // Records a hash computed elsewhere (0 for an unreadable file), e.g.
+    // by the model loader thread, and returns the key for it.
+    std::string remember(const std::string &path, uint64_t hash) {
+        std::string result = path;
+        if(hash != 0) {
+            char buf[24];
+            snprintf(buf, sizeof(buf), "#%016llx", static_cast<unsigned long long>(hash));
+            result = buf;
+        }
+        keys[path] = result;
+        return result;
+    }
+
+private:
+    std::unordered_map<std::string, std::string> aliases;
+    std::unordered_map<std::string, std::string> keys;
+};
+
+// Pairs (copy, original) among names, relative to dir, whose bytes match
+// an earlier name's; the original is always the first listed.
+inline std::vector<std::pair<std::string, std::string>> findDuplicateAssets(const std::string &dir, const std::vector<std::string> &names) {
+    std::vector<std::pair<std::string, std::string>> copies;
+    std::unordered_map<uint64_t, std::vector<size_t>> seen;
+    std::vector<std::string> contents(names.size());
+    for(size_t i = 0; i < names.size(); ++i) {
+        if(!readFileBytes(dir + "/" + names[i], contents[i])) continue;
+        auto &same = seen[fnv1a(contents[i])];
+        bool found = false;
+        for(size_t j : same) {
+            if(names[j] == names[i]) {
+                found = true;
+                break;
+            }
+            if(contents[j] == contents[i]) {
+                copies.emplace_back(names[i], names[j]);
+                found = true;
+                break;
+            }
+        }
+        if(found) contents[i].clear();
+        else same.push_back(i);
+    }
+    return copies;
+}
+
+#endif
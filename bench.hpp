@@ -0,0 +1,221 @@
+#ifndef __BENCH_HPP_
+#define __BENCH_HPP_
+
+#include"gl.hpp"
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstring>
+#include<ostream>
+#include<string>
+#include<vector>
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+#ifdef __EMSCRIPTEN__
+extern "C" void glGetQueryObjectui64vEXT(GLuint id, GLenum pname, GLuint64 *params);
+#endif
+
+struct FrameTimeStats {
+    size_t count = 0;
+    double min_ms = 0.0;
+    double median_ms = 0.0;
+    double p99_ms = 0.0;
+    double mean_ms = 0.0;
+};
+
+inline FrameTimeStats computeFrameStats(std::vector<double> samples) {
+    FrameTimeStats stats;
+    if(samples.empty()) return stats;
+    std::sort(samples.begin(), samples.end());
+    stats.count = samples.size();
+    stats.min_ms = samples.front();
+    stats.median_ms = samples[samples.size() / 2];
+    size_t rank = (samples.size() * 99 + 99) / 100;
+    stats.p99_ms = samples[std::min(rank, samples.size()) - 1];
+    double total = 0.0;
+    for(double s : samples) total += s;
+    stats.mean_ms = total / samples.size();
+    return stats;
+}
+
+inline bool hasGLExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i = 0; i < count; ++i) {
+        const char *ext = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if(ext && std::strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
+inline std::string glString(GLenum name) {
+    const char *s = reinterpret_cast<const char *>(glGetString(name));
+    return s ? s : "";
+}
+
+// Elapsed time of a finished query in nanoseconds. The result is read as
+// 64 bits; a 32-bit read wraps after about 4.3 seconds.
+inline GLuint64 queryNanoseconds(GLuint query) {
+    GLuint64 ns = 0;
+#ifdef __EMSCRIPTEN__
+    glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT, &ns);
+#else
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+#endif
+    return ns;
+}
+
+// Software rasterizers (llvmpipe, softpipe) report CPU time for
+// GL_TIME_ELAPSED queries, so they are treated as having no GPU timer.
+inline bool hasGpuTimer() {
+    std::string renderer = glString(GL_RENDERER);
+    bool software = renderer.find("llvmpipe") != std::string::npos ||
+                    renderer.find("softpipe") != std::string::npos;
+    bool timer = hasGLExtension("GL_ARB_timer_query") ||
+                 hasGLExtension("GL_EXT_disjoint_timer_query_webgl2") ||
+                 hasGLExtension("GL_EXT_disjoint_timer_query");
+    return timer && !software;
+}
+
+// Only the EXT timer queries define GL_GPU_DISJOINT_EXT; asking for it
+// with just ARB_timer_query is an INVALID_ENUM.
+inline bool hasDisjointQuery() {
+    return hasGLExtension("GL_EXT_disjoint_timer_query_webgl2") ||
+           hasGLExtension("GL_EXT_disjoint_timer_query");
+}
+
+inline bool gpuDisjoint() {
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    return disjoint != 0;
+}
+
+// Measures GPU time per frame with GL_TIME_ELAPSED queries when the driver
+// has them; otherwise the frame is bracketed by glFinish.
+class FrameTimer {
+public:
+    enum class Mode { TimerQuery, Finish };
+
+    void init(size_t maxFrames) {
+        mode = hasGpuTimer() ? Mode::TimerQuery : Mode::Finish;
+        disjointQuery = mode == Mode::TimerQuery && hasDisjointQuery();
+        if(mode == Mode::TimerQuery) {
+            queries.resize(maxFrames);
+            glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+        }
+        samples.reserve(maxFrames);
+    }
+
+    ~FrameTimer() {
+        if(!queries.empty()) glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    void reset() {
+        samples.clear();
+        pending = 0;
+    }
+
+    void begin() {
+        if(mode == Mode::TimerQuery) {
+            glBeginQuery(GL_TIME_ELAPSED_EXT, queries[pending]);
+        } else {
+            glFinish();
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    void end() {
+        if(mode == Mode::TimerQuery) {
+            glEndQuery(GL_TIME_ELAPSED_EXT);
+            pending++;
+        } else {
+            glFinish();
+            auto stop = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+    }
+
+    std::vector<double> collect() {
+        if(mode == Mode::TimerQuery) {
+            glFinish();
+            bool disjoint = disjointQuery && gpuDisjoint();
+            for(size_t i = 0; i < pending; ++i) {
+                samples.push_back(queryNanoseconds(queries[i]) / 1.0e6);
+            }
+            if(disjoint) {
+                printf("FrameTimer: GPU timer disjoint, samples may be unreliable\n");
+            }
+            pending = 0;
+        }
+        return samples;
+    }
+
+    Mode getMode() const { return mode; }
+    const char *modeName() const { return mode == Mode::TimerQuery ? "timer_query" : "glfinish"; }
+
+private:
+    Mode mode = Mode::Finish;
+    std::vector<GLuint> queries;
+    std::vector<double> samples;
+    size_t pending = 0;
+    bool disjointQuery = false;
+    std::chrono::steady_clock::time_point start;
+};
+
+inline std::string jsonEscape(const std::string &text) {
+    std::string out;
+    out.reserve(text.size());
+    for(char c : text) {
+        switch(c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if(static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+struct BenchResult {
+    std::string shader;
+    int index = 0;
+    std::string mode;
+    int width = 0, height = 0;
+    FrameTimeStats stats;
+};
+
+// One result per line in a fixed order so two reports diff cleanly.
+inline void writeBenchReport(std::ostream &out, const std::string &timing, int frames, const std::vector<BenchResult> &results) {
+    char buf[512];
+    out << "{\n";
+    out << "  \"renderer\": \"" << jsonEscape(glString(GL_RENDERER)) << "\",\n";
+    out << "  \"version\": \"" << jsonEscape(glString(GL_VERSION)) << "\",\n";
+    out << "  \"timing\": \"" << timing << "\",\n";
+    out << "  \"frames\": " << frames << ",\n";
+    out << "  \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &r = results[i];
+        snprintf(buf, sizeof(buf),
+                 "\"index\": %d, \"mode\": \"%s\", \"width\": %d, \"height\": %d, \"min_ms\": %.3f, \"median_ms\": %.3f, \"p99_ms\": %.3f, \"mean_ms\": %.3f",
+                 r.index, r.mode.c_str(), r.width, r.height, r.stats.min_ms, r.stats.median_ms, r.stats.p99_ms, r.stats.mean_ms);
+        out << "    {\"shader\": \"" << jsonEscape(r.shader) << "\", " << buf << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+#endif
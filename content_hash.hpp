@@ -0,0 +1,30 @@
+#ifndef __CONTENT_HASH_HPP_
+#define __CONTENT_HASH_HPP_
+
+#include<cstddef>
+#include<cstdint>
+#include<fstream>
+#include<iterator>
+#include<string>
+
+// 64-bit FNV-1a. Passing an earlier result as hash continues it, so
+// several buffers can be hashed as one.
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a(const std::string &data) { return fnv1a(data.data(), data.size()); }
+
+inline bool readFileBytes(const std::string &filename, std::string &out) {
+    std::ifstream file(filename, std::ios::binary);
+    if(!file.is_open()) return false;
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef __FRAME_PACER_HPP_
+#define __FRAME_PACER_HPP_
+
+#include"mx.hpp"
+#include<SDL2/SDL.h>
+#include<algorithm>
+#include<array>
+#include<chrono>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<thread>
+#ifdef __EMSCRIPTEN__
+#include<emscripten/emscripten.h>
+#endif
+
+enum class PacingMode { VSync, FixedFPS, Uncapped };
+
+inline const char *pacingModeName(PacingMode mode) {
+    switch(mode) {
+        case PacingMode::VSync: return "vsync";
+        case PacingMode::FixedFPS: return "fixed";
+        case PacingMode::Uncapped: return "uncapped";
+    }
+    return "unknown";
+}
+
+// Accepts "vsync", "uncapped" or a frame rate such as "30".
+inline bool parsePacing(const std::string &text, PacingMode &mode, double &fps) {
+    if(text == "vsync") {
+        mode = PacingMode::VSync;
+        return true;
+    }
+    if(text == "uncapped") {
+        mode = PacingMode::Uncapped;
+        return true;
+    }
+    double value = atof(text.c_str());
+    if(value <= 0.0) return false;
+    mode = PacingMode::FixedFPS;
+    fps = value;
+    return true;
+}
+
+struct PacingStats {
+    size_t frames = 0;
+    double mean_ms = 0.0;
+    double jitter_ms = 0.0;
+    double min_ms = 0.0;
+    double max_ms = 0.0;
+    double p99_ms = 0.0;
+    size_t late = 0;
+};
+
+// Decides when the next frame starts and how long the gap between
+// presented frames really was. Natively, vsync is SDL's swap interval and a
+// fixed rate sleeps to an absolute schedule, then spins for the last
+// couple of milliseconds because SDL_Delay/sleep_until overshoot. In the
+// browser the same modes map onto emscripten's main loop timing
+// (requestAnimationFrame, setTimeout or setImmediate).
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr size_t HISTORY = 240;
+
+    void setMode(PacingMode value, double fps = 60.0) {
+        mode = value;
+        if(fps > 0.0) targetFps = fps;
+        period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+        next = clock::time_point();
+        pending = true;
+        resetStats();
+    }
+
+    PacingMode getMode() const { return mode; }
+    double getTargetFps() const { return targetFps; }
+
+    // Applies a mode change; call with the GL context current (natively) or
+    // from inside the running main loop (emscripten).
+    void apply() {
+        if(!pending) return;
+        pending = false;
+#ifdef __EMSCRIPTEN__
+        if(mode == PacingMode::VSync) {
+            emscripten_set_main_loop_timing(EM_TIMING_RAF, 1);
+        } else if(mode == PacingMode::FixedFPS) {
+            emscripten_set_main_loop_timing(EM_TIMING_SETTIMEOUT, std::max(1, static_cast<int>(1000.0 / targetFps + 0.5)));
+        } else {
+            emscripten_set_main_loop_timing(EM_TIMING_SETIMMEDIATE, 0);
+        }
+#else
+        if(SDL_GL_SetSwapInterval(mode == PacingMode::VSync ? 1 : 0) != 0 && mode == PacingMode::VSync) {
+            mx::system_err << "acmx2: vsync unavailable (" << SDL_GetError() << "), using a fixed " << std::lround(targetFps) << " fps\n";
+            mode = PacingMode::FixedFPS;
+        }
+#endif
+    }
+
+    // Blocks until the next frame is due (fixed mode, native only).
+    void wait() {
+#ifndef __EMSCRIPTEN__
+        if(mode != PacingMode::FixedFPS) return;
+        clock::time_point now = clock::now();
+        // A frame that ran long restarts the schedule instead of letting the
+        // following frames run back to back to catch up.
+        if(next == clock::time_point() || now - next > period) next = now;
+        next += period;
+        clock::time_point wake = next - std::chrono::milliseconds(2);
+        if(now < wake) std::this_thread::sleep_until(wake);
+        while(clock::now() < next) {
+            std::this_thread::yield();
+        }
+#endif
+    }
+
+    // Nothing was presented, so there is no swap to block on; wait a frame
+    // rather than spin (native only, the browser paces its own loop).
+    void idle() {
+#ifndef __EMSCRIPTEN__
+        if(mode == PacingMode::FixedFPS) wait();
+        else std::this_thread::sleep_for(period);
+#endif
+    }
+
+    void frameDelivered() {
+        clock::time_point now = clock::now();
+        if(last != clock::time_point()) {
+            intervals[head] = std::chrono::duration<float, std::milli>(now - last).count();
+            head = (head + 1) % HISTORY;
+            count = std::min(count + 1, HISTORY);
+        }
+        last = now;
+    }
+
+    // Frames that were not presented (see About::needsRedraw) would show up
+    // as one long interval; start measuring again from the next one.
+    void frameSkipped() { last = clock::time_point(); }
+
+    void resetStats() {
+        head = count = 0;
+        last = clock::time_point();
+    }
+
+    // A frame is late when its interval exceeds 1.5x the expected one: the
+    // target period in fixed mode, otherwise the median interval.
+    PacingStats stats() const {
+        PacingStats s;
+        if(count == 0) return s;
+        std::array<float, HISTORY> sorted;
+        std::copy(intervals.begin(), intervals.begin() + count, sorted.begin());
+        std::sort(sorted.begin(), sorted.begin() + count);
+        double total = 0.0, squares = 0.0;
+        for(size_t i = 0; i < count; ++i) {
+            total += sorted[i];
+            squares += static_cast<double>(sorted[i]) * sorted[i];
+        }
+        s.frames = count;
+        s.mean_ms = total / count;
+        s.jitter_ms = std::sqrt(std::max(0.0, squares / count - s.mean_ms * s.mean_ms));
+        s.min_ms = sorted[0];
+        s.max_ms = sorted[count - 1];
+        s.p99_ms = sorted[std::min(count - 1, (count * 99) / 100)];
+        double expected = mode == PacingMode::FixedFPS ? 1000.0 / targetFps : sorted[count / 2];
+        for(size_t i = 0; i < count; ++i) {
+            if(sorted[i] > expected * 1.5) s.late++;
+        }
+        return s;
+    }
+
+    std::string toJSON() const {
+        PacingStats s = stats();
+        char buf[320];
+        snprintf(buf, sizeof(buf),
+                 "{\"mode\": \"%s\", \"target_fps\": %.2f, \"frames\": %zu, \"mean_ms\": %.3f, \"jitter_ms\": %.3f, \"min_ms\": %.3f, \"max_ms\": %.3f, \"p99_ms\": %.3f, \"late\": %zu}",
+                 pacingModeName(mode), targetFps, s.frames, s.mean_ms, s.jitter_ms, s.min_ms, s.max_ms, s.p99_ms, s.late);
+        return buf;
+    }
+
+private:
+    PacingMode mode = PacingMode::VSync;
+    double targetFps = 60.0;
+    clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+    clock::time_point next, last;
+    bool pending = true;
+    std::array<float, HISTORY> intervals{};
+    size_t head = 0, count = 0;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef __FRAME_STATS_HPP_
+#define __FRAME_STATS_HPP_
+
+#include<array>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<cstdio>
+#include<string>
+
+enum class FramePhase : uint8_t { Frame = 0, Uniforms, TextureUpload, DrawSubmit, Capture, Present, Count };
+
+inline const char *framePhaseName(FramePhase phase) {
+    switch(phase) {
+        case FramePhase::Frame: return "frame";
+        case FramePhase::Uniforms: return "uniforms";
+        case FramePhase::TextureUpload: return "texture_upload";
+        case FramePhase::DrawSubmit: return "draw_submit";
+        case FramePhase::Capture: return "capture";
+        case FramePhase::Present: return "present";
+        default: return "unknown";
+    }
+}
+
+struct PhaseSample {
+    FramePhase phase = FramePhase::Frame;
+    float ms = 0.0f;
+};
+
+// Bounded multi-producer ring (Vyukov style): producers claim a slot with a
+// CAS on head and publish it through the slot sequence number, so recording
+// never blocks and a full ring simply drops the sample.
+template<size_t N>
+class SampleRing {
+    static_assert((N & (N - 1)) == 0, "SampleRing size must be a power of two");
+public:
+    SampleRing() {
+        for(size_t i = 0; i < N; ++i) slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const PhaseSample &sample) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for(;;) {
+            Slot &slot = slots[pos & (N - 1)];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0) {
+                if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = sample;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(PhaseSample &sample) {
+        Slot &slot = slots[tail & (N - 1)];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if(static_cast<intptr_t>(seq) - static_cast<intptr_t>(tail + 1) < 0) return false;
+        sample = slot.value;
+        slot.seq.store(tail + N, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        PhaseSample value;
+    };
+    std::array<Slot, N> slots;
+    std::atomic<size_t> head{0};
+    size_t tail = 0;
+};
+
+class PhaseHistogram {
+public:
+    static constexpr size_t BUCKETS = 12;
+    static constexpr float edges[BUCKETS - 1] = { 0.05f, 0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f, 16.7f, 33.3f, 66.7f };
+
+    void add(float ms) {
+        size_t b = 0;
+        while(b < BUCKETS - 1 && ms >= edges[b]) b++;
+        buckets[b]++;
+        if(count == 0 || ms < min_ms) min_ms = ms;
+        if(ms > max_ms) max_ms = ms;
+        total_ms += ms;
+        count++;
+    }
+
+    // Upper edge of the bucket holding the requested rank; the last bucket
+    // reports the largest sample seen.
+    float percentile(double p) const {
+        if(count == 0) return 0.0f;
+        uint64_t rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for(size_t b = 0; b < BUCKETS; ++b) {
+            seen += buckets[b];
+            if(seen >= rank) return b < BUCKETS - 1 ? edges[b] : max_ms;
+        }
+        return max_ms;
+    }
+
+    void reset() { *this = PhaseHistogram(); }
+
+    std::array<uint64_t, BUCKETS> buckets{};
+    uint64_t count = 0;
+    double total_ms = 0.0;
+    float min_ms = 0.0f, max_ms = 0.0f;
+};
+
+class FrameStats {
+public:
+    static FrameStats &instance() {
+        static FrameStats stats;
+        return stats;
+    }
+
+    void record(FramePhase phase, float ms) {
+        if(!ring.push({phase, ms})) dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void endFrame() {
+        frames++;
+        aggregate();
+    }
+
+    // Model meshes submitted and skipped by frustum culling; called from
+    // the render thread only.
+    void recordMeshes(uint32_t drawn, uint32_t culled) {
+        meshesDrawn += drawn;
+        meshesCulled += culled;
+        lastDrawn = drawn;
+        lastCulled = culled;
+    }
+
+    void aggregate() {
+        PhaseSample s;
+        while(ring.pop(s)) {
+            histograms[static_cast<size_t>(s.phase)].add(s.ms);
+        }
+    }
+
+    void reset() {
+        aggregate();
+        for(auto &h : histograms) h.reset();
+        frames = 0;
+        meshesDrawn = meshesCulled = 0;
+        lastDrawn = lastCulled = 0;
+        dropped.store(0, std::memory_order_relaxed);
+    }
+
+    std::string toJSON() {
+        aggregate();
+        std::string out = "{\"enabled\": true, \"frames\": " + std::to_string(frames) +
+                          ", \"dropped\": " + std::to_string(dropped.load(std::memory_order_relaxed)) +
+                          ", \"meshes\": {\"drawn\": " + std::to_string(meshesDrawn) + ", \"culled\": " + std::to_string(meshesCulled) +
+                          ", \"last_drawn\": " + std::to_string(lastDrawn) + ", \"last_culled\": " + std::to_string(lastCulled) + "}" +
+                          ", \"bucket_edges_ms\": [";
+        char buf[256];
+        for(size_t i = 0; i < PhaseHistogram::BUCKETS - 1; ++i) {
+            snprintf(buf, sizeof(buf), "%s%.2f", i ? ", " : "", PhaseHistogram::edges[i]);
+            out += buf;
+        }
+        out += "], \"phases\": [";
+        for(size_t p = 0; p < static_cast<size_t>(FramePhase::Count); ++p) {
+            const PhaseHistogram &h = histograms[p];
+            snprintf(buf, sizeof(buf),
+                     "%s{\"name\": \"%s\", \"count\": %llu, \"mean_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"buckets\": [",
+                     p ? ", " : "", framePhaseName(static_cast<FramePhase>(p)), static_cast<unsigned long long>(h.count),
+                     h.count ? h.total_ms / h.count : 0.0, h.min_ms, h.max_ms, h.percentile(0.5), h.percentile(0.99));
+            out += buf;
+            for(size_t b = 0; b < PhaseHistogram::BUCKETS; ++b) {
+                out += (b ? ", " : "") + std::to_string(h.buckets[b]);
+            }
+            out += "]}";
+        }
+        out += "]}";
+        return out;
+    }
+
+private:
+    FrameStats() = default;
+    SampleRing<4096> ring;
+    std::array<PhaseHistogram, static_cast<size_t>(FramePhase::Count)> histograms;
+    std::atomic<uint64_t> dropped{0};
+    uint64_t frames = 0;
+    uint64_t meshesDrawn = 0, meshesCulled = 0;
+    uint32_t lastDrawn = 0, lastCulled = 0;
+};
+
+class ScopedPhase {
+public:
+    explicit ScopedPhase(FramePhase p) : phase(p), start(std::chrono::steady_clock::now()) {}
+    ~ScopedPhase() {
+        auto stop = std::chrono::steady_clock::now();
+        FrameStats::instance().record(phase, std::chrono::duration<float, std::milli>(stop - start).count());
+    }
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+private:
+    FramePhase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define FRAME_STATS_CONCAT_(a, b) a##b
+#define FRAME_STATS_CONCAT(a, b) FRAME_STATS_CONCAT_(a, b)
+
+#ifdef MX_FRAME_STATS
+#define FRAME_PHASE(p) ScopedPhase FRAME_STATS_CONCAT(frame_phase_, __LINE__)(p)
+#define FRAME_STATS_END_FRAME() FrameStats::instance().endFrame()
+#define FRAME_STATS_MESHES(drawn, culled) FrameStats::instance().recordMeshes(drawn, culled)
+#define FRAME_STATS_JSON() FrameStats::instance().toJSON()
+#else
+#define FRAME_PHASE(p) ((void)0)
+#define FRAME_STATS_END_FRAME() ((void)0)
+#define FRAME_STATS_MESHES(drawn, culled) ((void)0)
+#define FRAME_STATS_JSON() std::string("{\"enabled\": false}")
+#endif
+
+#endif
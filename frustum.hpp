@@ -0,0 +1,95 @@
+#ifndef __FRUSTUM_HPP_
+#define __FRUSTUM_HPP_
+
+#include<cmath>
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<vector>
+
+// Four-wide float and mask vectors (GCC/Clang vector extensions). They
+// become SSE natively and wasm SIMD when em++ is given -msimd128; without
+// it they are split into scalar operations.
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int32_t Mask4 __attribute__((vector_size(16)));
+
+// Mesh bounds as structure-of-arrays, padded to a multiple of four: the
+// centre shared by the bounding sphere and box, the sphere radius and the
+// box half-extents.
+struct MeshBounds {
+    size_t count = 0;
+    std::vector<float> x, y, z, radius, ex, ey, ez;
+
+    void resize(size_t n) {
+        count = n;
+        size_t padded = (n + 3) & ~size_t(3);
+        for(auto *v : { &x, &y, &z, &radius, &ex, &ey, &ez }) v->assign(padded, 0.0f);
+    }
+
+    void set(size_t i, const float *center, float r, const float *extent) {
+        x[i] = center[0];
+        y[i] = center[1];
+        z[i] = center[2];
+        radius[i] = r;
+        ex[i] = extent[0];
+        ey[i] = extent[1];
+        ez[i] = extent[2];
+    }
+};
+
+// The six planes of a clip matrix (column-major, as glm stores it), with
+// normals pointing inwards and normalised so distances are in the
+// matrix's source space.
+struct Frustum {
+    float planes[6][4];
+
+    explicit Frustum(const float *m) {
+        for(int i = 0; i < 3; ++i) {
+            for(int k = 0; k < 4; ++k) {
+                planes[i * 2][k] = m[k * 4 + 3] + m[k * 4 + i];
+                planes[i * 2 + 1][k] = m[k * 4 + 3] - m[k * 4 + i];
+            }
+        }
+        for(auto &p : planes) {
+            float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            if(length > 0.0f) {
+                for(int k = 0; k < 4; ++k) p[k] /= length;
+            }
+        }
+    }
+};
+
+// Clears visible[i] for every mesh entirely outside a plane, four meshes
+// per step. A mesh is outside when its centre is further behind the plane
+// than the smaller of its sphere radius and its box's extent along the
+// normal, so long thin meshes are judged by their box. Returns the
+// number culled.
+inline size_t cullMeshes(const Frustum &frustum, const MeshBounds &bounds, std::vector<uint8_t> &visible) {
+    visible.assign(bounds.count, 1);
+    size_t culled = 0;
+    auto load = [](const std::vector<float> &v, size_t i) {
+        Float4 out;
+        std::memcpy(&out, v.data() + i, sizeof(out));
+        return out;
+    };
+    for(size_t i = 0; i < bounds.count; i += 4) {
+        Float4 x = load(bounds.x, i), y = load(bounds.y, i), z = load(bounds.z, i);
+        Float4 radius = load(bounds.radius, i);
+        Float4 ex = load(bounds.ex, i), ey = load(bounds.ey, i), ez = load(bounds.ez, i);
+        Mask4 outside = { 0, 0, 0, 0 };
+        for(const auto &p : frustum.planes) {
+            Float4 distance = x * p[0] + y * p[1] + z * p[2] + p[3];
+            Float4 reach = ex * std::fabs(p[0]) + ey * std::fabs(p[1]) + ez * std::fabs(p[2]);
+            outside |= (distance < -reach) | (distance < -radius);
+        }
+        for(size_t lane = 0; lane < 4 && i + lane < bounds.count; ++lane) {
+            if(outside[lane]) {
+                visible[i + lane] = 0;
+                culled++;
+            }
+        }
+    }
+    return culled;
+}
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef __GPU_MODEL_HPP_
+#define __GPU_MODEL_HPP_
+
+#include"gl.hpp"
+#include"model_data.hpp"
+#include"mesh_pack.hpp"
+#include"mesh_simplify.hpp"
+#include"vertex_quantize.hpp"
+#include"frustum.hpp"
+#include<algorithm>
+#include<array>
+#include<cmath>
+#include<cstddef>
+#include<cstdint>
+#include<fstream>
+#include<string>
+#include<utility>
+#include<vector>
+
+// A mesh is a set of ranges in its model's shared index buffer, one per
+// level of detail; level 0 is the full mesh. center is the middle of its
+// box, extent the box's half size and radius the sphere around center.
+struct GpuMesh {
+    GLsizei indexCount = 0;
+    uint32_t textureIndex = 0;
+    int levels = 1;
+    std::array<GLsizei, MESH_MAX_LODS + 1> levelCount{}, levelOffset{};
+    std::array<float, MESH_MAX_LODS + 1> levelError{};
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float extent[3] = { 0.0f, 0.0f, 0.0f };
+    float radius = 0.0f;
+
+    // The coarsest level whose error, scaled to pixels, stays under
+    // threshold. pixelsPerUnit <= 0 always picks the full mesh.
+    int selectLevel(float pixelsPerUnit, float threshold) const {
+        int level = 0;
+        if(pixelsPerUnit <= 0.0f) return level;
+        while(level + 1 < levels && levelError[level + 1] * pixelsPerUnit < threshold) level++;
+        return level;
+    }
+};
+
+// A model's meshes merged into one vertex buffer and one index buffer
+// behind a single vertex array, laid out for sz3DVertex (position at
+// location 0, normal at 1, texture coordinate at 2) or, when quantized,
+// as PackedVertex for sz3DVertexPacked with one position scale and bias
+// for the whole model. Indices are rebased onto the merged vertices
+// (WebGL 2 has no base-vertex draws) and stored level by level, so meshes
+// drawn at the same level are one contiguous range and one draw call.
+class GpuModel {
+public:
+    GpuModel() = default;
+    ~GpuModel() { release(); }
+    GpuModel(const GpuModel &) = delete;
+    GpuModel &operator=(const GpuModel &) = delete;
+    GpuModel(GpuModel &&other) noexcept { take(other); }
+    GpuModel &operator=(GpuModel &&other) noexcept {
+        if(this != &other) {
+            release();
+            take(other);
+        }
+        return *this;
+    }
+
+    bool upload(const ModelData &model, bool quantize = false) {
+        std::vector<uint32_t> indices;
+        return build(model.meshes.size(), [&](size_t i, MeshView &view) {
+            const MeshData &mesh = model.meshes[i];
+            view.vertices = mesh.vertices.data();
+            view.vertexCount = mesh.vertexCount();
+            view.indexCount = mesh.indices.size();
+            view.lodCount = std::min(mesh.lods.size(), MESH_MAX_LODS);
+            indices.assign(mesh.indices.begin(), mesh.indices.end());
+            for(size_t l = 0; l < view.lodCount; ++l) {
+                view.lodIndexCount[l] = static_cast<uint32_t>(mesh.lods[l].indices.size());
+                view.lodError[l] = mesh.lods[l].error;
+                indices.insert(indices.end(), mesh.lods[l].indices.begin(), mesh.lods[l].indices.end());
+            }
+            view.indices = indices.data();
+            view.textureIndex = mesh.textureIndex;
+            return true;
+        }, quantize);
+    }
+
+    bool upload(MeshPackFile &pack, bool quantize = false) {
+        return build(pack.meshCount(), [&](size_t i, MeshView &view) { return pack.mesh(i, view); }, quantize);
+    }
+
+    void release() {
+        if(vao != 0) glDeleteVertexArrays(1, &vao);
+        if(vbo != 0) glDeleteBuffers(1, &vbo);
+        if(ibo != 0) glDeleteBuffers(1, &ibo);
+        if(instanceVbo != 0) glDeleteBuffers(1, &instanceVbo);
+        vao = vbo = ibo = instanceVbo = 0;
+        meshes.clear();
+        bounds.resize(0);
+        totalBytes = 0;
+        quantized = false;
+    }
+
+    bool empty() const { return meshes.empty(); }
+    size_t bytes() const { return totalBytes; }
+
+    // Per-instance attributes: a column-major model matrix at locations
+    // 3 to 6 and a time offset at 7.
+    static constexpr size_t INSTANCE_FLOATS = 17;
+
+    // Replaces the instance data; count instances of INSTANCE_FLOATS
+    // floats each. The buffer is orphaned, so it can change every frame.
+    void uploadInstances(const float *data, size_t count) {
+        bool created = instanceVbo == 0;
+        if(created) glGenBuffers(1, &instanceVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferData(GL_ARRAY_BUFFER, count * INSTANCE_FLOATS * sizeof(float), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * INSTANCE_FLOATS * sizeof(float), data);
+        if(created) {
+            glBindVertexArray(vao);
+            pointInstances(0);
+            for(GLuint a = 3; a <= 7; ++a) {
+                glEnableVertexAttribArray(a);
+                glVertexAttribDivisor(a, 1);
+            }
+            glBindVertexArray(0);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Draws mesh i at levels[i], skipping meshes with a negative level.
+    // Ranges that follow each other in the index buffer go out as one
+    // call; returns the number of calls. With instances > 0 each call
+    // draws that many instances, starting at firstInstance in the
+    // uploaded instance data.
+    int draw(const int *levels, GLsizei instances = 0, size_t firstInstance = 0) const {
+        int calls = 0;
+        GLsizei runOffset = 0, runCount = 0;
+        auto flush = [&]() {
+            if(runCount == 0) return;
+            void *offset = reinterpret_cast<void *>(static_cast<size_t>(runOffset) * sizeof(uint32_t));
+            if(instances > 0)
+                glDrawElementsInstanced(GL_TRIANGLES, runCount, GL_UNSIGNED_INT, offset, instances);
+            else
+                glDrawElements(GL_TRIANGLES, runCount, GL_UNSIGNED_INT, offset);
+            calls++;
+        };
+        glBindVertexArray(vao);
+        if(instances > 0) {
+            // WebGL 2 has no base-instance draws, so the attributes are
+            // pointed at the first instance instead.
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+            pointInstances(firstInstance);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        for(size_t i = 0; i < meshes.size(); ++i) {
+            if(levels[i] < 0) continue;
+            const GpuMesh &m = meshes[i];
+            GLsizei offset = m.levelOffset[levels[i]], count = m.levelCount[levels[i]];
+            if(runCount > 0 && runOffset + runCount == offset) {
+                runCount += count;
+                continue;
+            }
+            flush();
+            runOffset = offset;
+            runCount = count;
+        }
+        flush();
+        glBindVertexArray(0);
+        return calls;
+    }
+
+    // Sphere around all the meshes' spheres, centred on their box.
+    float sphere(float *center) const {
+        float lo[3] = { 0.0f, 0.0f, 0.0f }, hi[3] = { 0.0f, 0.0f, 0.0f };
+        for(size_t i = 0; i < meshes.size(); ++i) {
+            for(int k = 0; k < 3; ++k) {
+                float a = meshes[i].center[k] - meshes[i].extent[k], b = meshes[i].center[k] + meshes[i].extent[k];
+                lo[k] = i == 0 ? a : std::min(lo[k], a);
+                hi[k] = i == 0 ? b : std::max(hi[k], b);
+            }
+        }
+        float radius = 0.0f;
+        for(int k = 0; k < 3; ++k) center[k] = 0.5f * (lo[k] + hi[k]);
+        for(const auto &m : meshes) {
+            float dx = m.center[0] - center[0], dy = m.center[1] - center[1], dz = m.center[2] - center[2];
+            radius = std::max(radius, std::sqrt(dx * dx + dy * dy + dz * dz) + m.radius);
+        }
+        return radius;
+    }
+
+    std::vector<GpuMesh> meshes;
+    MeshBounds bounds;
+    bool quantized = false;
+    float posScale[3] = { 1.0f, 1.0f, 1.0f };
+    float posBias[3] = { 0.0f, 0.0f, 0.0f };
+
+private:
+    void take(GpuModel &other) {
+        vao = other.vao;
+        vbo = other.vbo;
+        ibo = other.ibo;
+        instanceVbo = other.instanceVbo;
+        other.vao = other.vbo = other.ibo = other.instanceVbo = 0;
+        meshes = std::move(other.meshes);
+        other.meshes.clear();
+        bounds = std::move(other.bounds);
+        other.bounds.resize(0);
+        totalBytes = other.totalBytes;
+        quantized = other.quantized;
+        std::copy(other.posScale, other.posScale + 3, posScale);
+        std::copy(other.posBias, other.posBias + 3, posBias);
+    }
+
+    // The first pass sizes the buffers, lays out the ranges and finds the
+    // bounds; the second fills the buffers a mesh at a time, so deflated
+    // pack meshes are never all held in memory at once.
+    template<typename GetView>
+    bool build(size_t count, GetView getView, bool quantize) {
+        release();
+        meshes.resize(count);
+        std::array<size_t, MESH_MAX_LODS + 1> levelTotal{};
+        size_t vertexTotal = 0;
+        float lo[3] = { 0.0f, 0.0f, 0.0f }, hi[3] = { 0.0f, 0.0f, 0.0f };
+        for(size_t i = 0; i < count; ++i) {
+            MeshView view;
+            if(!getView(i, view)) {
+                meshes.clear();
+                return false;
+            }
+            GpuMesh &mesh = meshes[i];
+            mesh.indexCount = static_cast<GLsizei>(view.indexCount);
+            mesh.textureIndex = view.textureIndex;
+            mesh.levels = static_cast<int>(view.lodCount) + 1;
+            mesh.levelCount[0] = mesh.indexCount;
+            for(size_t l = 0; l < view.lodCount; ++l) {
+                mesh.levelCount[l + 1] = static_cast<GLsizei>(view.lodIndexCount[l]);
+                mesh.levelError[l + 1] = view.lodError[l];
+            }
+            for(int l = 0; l < mesh.levels; ++l) {
+                mesh.levelOffset[l] = static_cast<GLsizei>(levelTotal[l]);
+                levelTotal[l] += mesh.levelCount[l];
+            }
+            bound(view, mesh);
+            for(size_t v = 0; v < view.vertexCount; ++v) {
+                const float *p = view.vertices + v * MeshData::STRIDE;
+                for(int k = 0; k < 3; ++k) {
+                    lo[k] = vertexTotal + v == 0 ? p[k] : std::min(lo[k], p[k]);
+                    hi[k] = vertexTotal + v == 0 ? p[k] : std::max(hi[k], p[k]);
+                }
+            }
+            vertexTotal += view.vertexCount;
+        }
+        if(meshes.empty()) return false;
+        bounds.resize(meshes.size());
+        for(size_t i = 0; i < meshes.size(); ++i) bounds.set(i, meshes[i].center, meshes[i].radius, meshes[i].extent);
+        // Level l of every mesh starts after all meshes' finer levels.
+        size_t levelBase = 0;
+        for(size_t l = 0; l <= MESH_MAX_LODS; ++l) {
+            for(auto &mesh : meshes) {
+                if(static_cast<int>(l) < mesh.levels) mesh.levelOffset[l] += static_cast<GLsizei>(levelBase);
+            }
+            levelBase += levelTotal[l];
+        }
+        if(quantize) {
+            for(int k = 0; k < 3; ++k) {
+                posBias[k] = 0.5f * (lo[k] + hi[k]);
+                posScale[k] = std::max(0.5f * (hi[k] - lo[k]), 1e-6f);
+            }
+            quantized = true;
+        }
+        size_t vertexSize = quantized ? sizeof(PackedVertex) : MeshData::STRIDE * sizeof(float);
+        totalBytes = vertexTotal * vertexSize + levelBase * sizeof(uint32_t);
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ibo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexTotal * vertexSize, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, levelBase * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+        size_t firstVertex = 0;
+        bool ok = true;
+        for(size_t i = 0; i < count && ok; ++i) {
+            MeshView view;
+            if(!getView(i, view)) {
+                ok = false;
+                break;
+            }
+            if(quantized) {
+                packVertices(view.vertices, view.vertexCount, posScale, posBias, packed);
+                glBufferSubData(GL_ARRAY_BUFFER, firstVertex * vertexSize, packed.size() * vertexSize, packed.data());
+            } else {
+                glBufferSubData(GL_ARRAY_BUFFER, firstVertex * vertexSize, view.vertexCount * vertexSize, view.vertices);
+            }
+            const uint32_t *source = view.indices;
+            const GpuMesh &mesh = meshes[i];
+            for(int l = 0; l < mesh.levels; ++l) {
+                rebased.resize(mesh.levelCount[l]);
+                for(size_t j = 0; j < rebased.size(); ++j) rebased[j] = source[j] + static_cast<uint32_t>(firstVertex);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, static_cast<size_t>(mesh.levelOffset[l]) * sizeof(uint32_t), rebased.size() * sizeof(uint32_t), rebased.data());
+                source += mesh.levelCount[l];
+            }
+            firstVertex += view.vertexCount;
+        }
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        if(quantized) {
+            GLsizei stride = static_cast<GLsizei>(sizeof(PackedVertex));
+            glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, stride, reinterpret_cast<void *>(offsetof(PackedVertex, position)));
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, reinterpret_cast<void *>(offsetof(PackedVertex, normal)));
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(offsetof(PackedVertex, texCoord)));
+        } else {
+            GLsizei stride = static_cast<GLsizei>(MeshData::STRIDE * sizeof(float));
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(0));
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(3 * sizeof(float)));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(6 * sizeof(float)));
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        packed.clear();
+        rebased.clear();
+        if(!ok) release();
+        return ok;
+    }
+
+    // Points the instance attributes of the bound vertex array at the
+    // bound instance buffer, starting at instance first.
+    static void pointInstances(size_t first) {
+        GLsizei stride = static_cast<GLsizei>(INSTANCE_FLOATS * sizeof(float));
+        size_t base = first * INSTANCE_FLOATS * sizeof(float);
+        for(GLuint c = 0; c < 4; ++c) glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(base + c * 4 * sizeof(float)));
+        glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(base + 16 * sizeof(float)));
+    }
+
+    // Box of the vertex positions and the sphere around its centre.
+    static void bound(const MeshView &view, GpuMesh &mesh) {
+        if(view.vertexCount == 0) return;
+        float lo[3], hi[3];
+        for(int k = 0; k < 3; ++k) lo[k] = hi[k] = view.vertices[k];
+        for(size_t i = 1; i < view.vertexCount; ++i) {
+            const float *p = view.vertices + i * MeshData::STRIDE;
+            for(int k = 0; k < 3; ++k) {
+                lo[k] = std::min(lo[k], p[k]);
+                hi[k] = std::max(hi[k], p[k]);
+            }
+        }
+        for(int k = 0; k < 3; ++k) {
+            mesh.center[k] = 0.5f * (lo[k] + hi[k]);
+            mesh.extent[k] = 0.5f * (hi[k] - lo[k]);
+        }
+        float r2 = 0.0f;
+        for(size_t i = 0; i < view.vertexCount; ++i) {
+            const float *p = view.vertices + i * MeshData::STRIDE;
+            float dx = p[0] - mesh.center[0], dy = p[1] - mesh.center[1], dz = p[2] - mesh.center[2];
+            r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+        }
+        mesh.radius = std::sqrt(r2);
+    }
+
+    GLuint vao = 0, vbo = 0, ibo = 0, instanceVbo = 0;
+    size_t totalBytes = 0;
+    std::vector<PackedVertex> packed;
+    std::vector<uint32_t> rebased;
+};
+
+// Opens the .mxmb next to path. A pack that is damaged, from an older
+// version or built from other bytes than path now holds (hash, from
+// meshPackSourceHash) is rebuilt from path first, keeping its compression
+// when it can be read; one whose source is missing is used as is. With no
+// pack at all this returns false and the model loads from text.
+inline bool openMeshPackFor(const std::string &path, MeshPackFile &pack, uint64_t hash) {
+    std::string packPath = meshPackPath(path);
+    bool opened = pack.open(packPath);
+    if(opened && (hash == 0 || pack.sourceHash() == hash)) return true;
+    if(hash == 0 || (!opened && !std::ifstream(packPath, std::ios::binary).is_open())) return false;
+    bool compress = opened && !pack.isRaw();
+    pack.close();
+    ModelData data;
+    return importMxmod(path, data) && writeMeshPack(packPath, data, compress, hash) && pack.open(packPath);
+}
+
+inline bool openMeshPackFor(const std::string &path, MeshPackFile &pack) {
+    return openMeshPackFor(path, pack, meshPackSourceHash(path));
+}
+
+// Loads path, preferring the .mxmb next to it when there is one.
+inline bool loadGpuModel(const std::string &path, GpuModel &model, bool quantize = false) {
+    MeshPackFile pack;
+    if(openMeshPackFor(path, pack)) return model.upload(pack, quantize);
+    if(pack.open(path)) return model.upload(pack, quantize);
+    ModelData data;
+    return loadMxmod(path, data) && model.upload(data, quantize);
+}
+
+#endif
@@ -28,6 +28,23 @@ GPL v3
 
 #include"mirror_shaders.hpp"
 #include"model.hpp"
+#include"headless.hpp"
+#include"render_target.hpp"
+#include"bench.hpp"
+#include"frame_stats.hpp"
+#include"shader_profile.hpp"
+#include"trace.hpp"
+#include"resolution_scaler.hpp"
+#include"quality_governor.hpp"
+#include"uniform_usage.hpp"
+#include"frame_pacer.hpp"
+#include"thumbnail_atlas.hpp"
+#include"loop_cache.hpp"
+#include"screen_quad.hpp"
+#include"model_cache.hpp"
+#include"model_loader.hpp"
+#include"model_instances.hpp"
+#include"asset_store.hpp"
 #define CHECK_GL_ERROR() \
 { GLenum err = glGetError(); \
 if (err != GL_NO_ERROR) \
@@ -42,10 +59,17 @@ struct ShaderInfo {
     std::string source;
 };
 
+// With INSTANCED defined (see vertexVariant) both 3D vertex stages take
+// a model matrix and time offset per instance.
 const char *sz3DVertex = R"(#version 300 es
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoord;
+#ifdef INSTANCED
+layout (location = 3) in mat4 instanceMatrix;
+layout (location = 7) in float instanceTimeOffset;
+flat out float instanceTime;
+#endif
 
 out vec3 vNormal;
 out vec2 TexCoord;
@@ -54,11 +78,87 @@ uniform mat4 mv_matrix;
 uniform mat4 proj_matrix;
 
 void main() {
+#ifdef INSTANCED
+    gl_Position = proj_matrix * mv_matrix * instanceMatrix * vec4(position, 1.0);
+    vNormal = normalize(mat3(instanceMatrix) * normal);
+    instanceTime = instanceTimeOffset;
+#else
     gl_Position = proj_matrix * mv_matrix * vec4(position, 1.0);
     vNormal = normal;
+#endif
+    TexCoord = texCoord;
+})";
+
+// sz3DVertex for quantized models (PackedVertex): normalised short
+// positions scaled back into the model's box, octahedral normals and
+// half-float texture coordinates.
+const char *sz3DVertexPacked = R"(#version 300 es
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec2 normal;
+layout (location = 2) in vec2 texCoord;
+#ifdef INSTANCED
+layout (location = 3) in mat4 instanceMatrix;
+layout (location = 7) in float instanceTimeOffset;
+flat out float instanceTime;
+#endif
+
+out vec3 vNormal;
+out vec2 TexCoord;
+
+uniform mat4 mv_matrix;
+uniform mat4 proj_matrix;
+uniform vec3 posScale;
+uniform vec3 posBias;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+#ifdef INSTANCED
+    gl_Position = proj_matrix * mv_matrix * instanceMatrix * vec4(position.xyz * posScale + posBias, 1.0);
+    vNormal = normalize(mat3(instanceMatrix) * octDecode(normal));
+    instanceTime = instanceTimeOffset;
+#else
+    gl_Position = proj_matrix * mv_matrix * vec4(position.xyz * posScale + posBias, 1.0);
+    vNormal = octDecode(normal);
+#endif
     TexCoord = texCoord;
 })";
 
+// The 3D vertex stage for a program3D variant: bit 0 quantized, bit 1
+// instanced.
+static std::string vertexVariant(int variant) {
+    std::string source = (variant & 1) ? sz3DVertexPacked : sz3DVertex;
+    if(variant & 2) source.insert(source.find('\n') + 1, "#define INSTANCED\n");
+    return source;
+}
+
+// Pastes the shared helper block over each line COLOR_HELPERS left.
+static std::string expandShaderIncludes(std::string source) {
+    static const std::string line = "#include \"color_helpers\"";
+    static const std::string helpers = szColorHelpers;
+    for(size_t pos = source.find(line); pos != std::string::npos; pos = source.find(line, pos + helpers.size())) {
+        source.replace(pos, line.size(), helpers);
+    }
+    return source;
+}
+
+// Instanced effects see time_f shifted by the instance's offset: the
+// name is redefined right after its declaration (a macro does not expand
+// inside itself, so the uniform is still what time_f reads).
+static std::string instanceFragmentSource(const std::string &source) {
+    static const std::string declaration = "uniform float time_f;";
+    size_t pos = source.find(declaration);
+    if(pos == std::string::npos) return source;
+    pos += declaration.size();
+    return source.substr(0, pos) + "\nflat in float instanceTime;\n#define time_f (time_f + instanceTime)\n" + source.substr(pos);
+}
+
 
 static std::vector<ShaderInfo> shaderSources = {
     {"Bubble", srcShader1},
@@ -216,14 +316,14 @@ public:
         return values;
     }
 
-    void init(gl::GLWindow *win, const std::string &filename) {
+    void init(gl::GLWindow *win, const std::string &filename, const AssetStore &assets) {
         std::string value = mx::readFileToString(filename);
         char c = 0;
         int index = 0;
         std::string token;
         std::vector<std::string> values = tokenize(value);
         for(size_t i = 0; i < values.size(); ++i)  {
-            auto shader_contents =  mx::readFileToString(win->util.getFilePath("data/shaders/" + values[i]));
+            auto shader_contents =  mx::readFileToString(assets.resolve(win->util.getFilePath("data/shaders/" + values[i])));
             if(!shader_contents.empty())
                 shaders.push_back(std::make_pair(values[i], shader_contents));
         }
@@ -251,10 +351,16 @@ protected:
 class About : public gl::GLObject {
     GLuint texture = 0;
     gl::ShaderProgram shader;
-    gl::GLSprite sprite;
+    ScreenQuads quads;
     float animation = 0.0f;
-    std::vector<std::unique_ptr<gl::ShaderProgram>> shaders;
-    std::vector<std::unique_ptr<gl::ShaderProgram>> shaders2;
+    // Shared so effects with identical sources use one pair of programs.
+    std::vector<std::shared_ptr<gl::ShaderProgram>> shaders;
+    std::vector<std::shared_ptr<gl::ShaderProgram>> shaders2;
+    std::unordered_map<uint64_t, size_t> compiledEffects;
+    // Effects relinked with another 3D vertex stage, by program3D variant
+    // minus one: quantized, instanced, both.
+    std::array<std::vector<std::unique_ptr<gl::ShaderProgram>>, 3> shaderVariants;
+    std::vector<std::string> fragmentSources;
     std::vector<std::string> shader_names;
     size_t currentShaderIndex = 0;
     Uint32 firstTapTime = 0;
@@ -293,10 +399,60 @@ class About : public gl::GLObject {
     int loadingShaderIndex = 0;
     bool loadingComplete = false;
     gl::GLWindow* loadingWin = nullptr;
-    std::unique_ptr<mx::Model> model;
+    ModelCache models;
+    GpuModel *model = nullptr;
+    ModelLoader loader;
+    std::string modelPath;
+    bool quantizeModels = false;
+    float lodThreshold = 1.0f;
+    std::array<size_t, MESH_MAX_LODS + 1> lodLevels{};
+    size_t lodTriangles = 0;
+    std::vector<int> meshLevels;
+    std::vector<uint8_t> meshVisible;
+    size_t meshesCulled = 0;
+    int modelDrawCalls = 0;
+    InstanceField instances;
+    size_t instanceCount = 0;
+    float instanceTimeSpread = 0.0f;
+    const GpuModel *instanceModel = nullptr;
+    std::string instancePath;
+    InstanceField::Stats instanceStats;
     bool is3d = false;
     ShaderLibrary library;
+    AssetStore assets;
     int currentFileIndex = 0;
+    std::vector<size_t> chain;
+    RenderTargetPool targetPool;
+    ResolutionScaler scaler;
+    QualityGovernor governor;
+    GpuFrameClock gpuClock;
+    double cpuRenderMs = 0.0;
+    float renderScale = 1.0f;
+    RenderTarget feedback[2];
+    int feedbackIndex = 0;
+    bool feedbackEnabled = false;
+    std::vector<uint32_t> uniformUse;
+    bool idleSkipping = false;
+    bool redrawRequested = true;
+    std::array<float, 25> drawnInputs{};
+    std::vector<int8_t> opacity;
+    uint64_t opacityKey = 0;
+    bool opaqueFrame = false;
+    ThumbnailAtlas thumbs;
+    bool browsing = false;
+    double thumbnailBudgetMs = 4.0;
+    std::string thumbnailCache;
+    uint64_t textureHash = 0;
+    uint64_t thumbnailKeyValue = 0;
+    int atlasX = 0, atlasY = 0;
+    float atlasScale = 1.0f;
+    LoopCache loopCache;
+    bool loopMode = false;
+    double loopPeriod = 15.0, loopFps = 30.0;
+    float loopScale = 0.5f;
+    size_t loopBudget = size_t(256) << 20;
+    std::string startupImage = "data/logo.png";
+    std::string capturePath = "acmx2.visualizer.png";
 public:
     About() = default;
     virtual ~About() override {
@@ -308,6 +464,9 @@ public:
     void set3DMode(bool is3d_m) {
         is3d = is3d_m;
     }
+    void setStartupImage(const std::string &filename) { startupImage = filename; }
+    void setCapturePath(const std::string &filename) { capturePath = filename; }
+    bool isLoadingComplete() const { return loadingComplete; }
     int getShaderIndex() const { return currentShaderIndex; }
     void setShaderIndex(int index) { currentShaderIndex = index; }
     int getShaderCount() { return static_cast<int>(shader_names.size());  }
@@ -352,13 +511,20 @@ public:
     }
 
     void loadNewTexture(SDL_Surface *surface, gl::GLWindow *win) {
+        TRACE_SCOPE("texture", "loadNewTexture");
         if(texture != 0) {
             glDeleteTextures(1, &texture);
             texture = 0;
         }
-        texture = createTexture(surface, true);
+        {
+            FRAME_PHASE(FramePhase::TextureUpload);
+            texture = createTexture(surface, true);
+            redrawRequested = true;
+        }
         texWidth = surface->w;
         texHeight = surface->h;
+        textureHash = fnv1a(surface->pixels, static_cast<size_t>(surface->h) * surface->pitch);
+        opacity.clear();
         
         
         canvasWidth = maxWidth; 
@@ -391,8 +557,9 @@ public:
         win->w = canvasWidth;
         win->h = canvasHeight;
         glViewport(0, 0, canvasWidth, canvasHeight);
+        targetPool.trim();
         
-        sprite.initSize(canvasWidth, canvasHeight);
+        quads.setSurface(canvasWidth, canvasHeight);
         switchShader(currentShaderIndex, win);
     }
 
@@ -420,8 +587,34 @@ public:
             }, info.name.c_str(), loadingShaderIndex + 1, (int)shaderSources.size());
 #endif
             
+            uint64_t hash = fnv1a(info.source);
+            auto same = compiledEffects.find(hash);
+            // The sources are compared too, so a hash collision compiles
+            // the effect on its own instead of aliasing another.
+            if(same != compiledEffects.end() && fragmentSources[same->second] == info.source) {
+                size_t original = same->second;
+                shaders.push_back(shaders[original]);
+                shaders2.push_back(shaders2[original]);
+                uniformUse.push_back(uniformUse[original]);
+                fragmentSources.push_back(info.source);
+                shader_names.push_back(info.name);
+                std::cout << "Shared: " << info.name << " = " << shader_names[original] << "\n";
+                loadingShaderIndex++;
+#ifdef __EMSCRIPTEN__
+                emscripten_async_call([](void* arg) {
+                    About* self = static_cast<About*>(arg);
+                    self->loadNextShader();
+                }, this, 0);
+#endif
+                return;
+            }
+
+            ShaderProfiler &profiler = ShaderProfiler::instance();
             auto shader = std::make_unique<gl::ShaderProgram>();
-            bool success = shader->loadProgramFromText(sz3DVertex, info.source);
+            TRACE_SCOPE_DETAIL("shader", info.name.c_str(), "compile");
+            bool success = profiler.load(info.name, "3d", sz3DVertex, info.source, [&]() {
+                return shader->loadProgramFromText(sz3DVertex, info.source);
+            });
             
 
             if(success) {
@@ -429,7 +622,9 @@ public:
             } 
 
             auto shader2 = std::make_unique<gl::ShaderProgram>();
-            bool success2 = shader2->loadProgramFromText(gl::vSource, info.source);
+            bool success2 = profiler.load(info.name, "2d", gl::vSource, info.source, [&]() {
+                return shader2->loadProgramFromText(gl::vSource, info.source);
+            });
             if(success2) {
                 std::cout << "Compiled: " << info.name << " [OK]\n";
             }
@@ -456,12 +651,15 @@ public:
                 if (success) {
                     shader->setSilent(true);
                     shaders.push_back(std::move(shader));
+                    fragmentSources.push_back(info.source);
                 }
                 if(success2) {
                     shader2->setSilent(true);
+                    uniformUse.push_back(reflectUniformUse(shader2->id()));
                     shaders2.push_back(std::move(shader2));
                 }
                 shader_names.push_back(info.name);
+                compiledEffects[hash] = shaders.size() - 1;
             } else {
                 std::cout << "Failed: " << info.name << "\n";
             } 
@@ -480,6 +678,7 @@ public:
     }
     
     void finishLoading() {
+        ShaderProfiler::instance().finish();
         if (shaders.empty()) {
             mx::system_err << "No shaders loaded successfully\n";
             return;
@@ -499,10 +698,10 @@ public:
         }, (int)shaders.size());
 #endif
         
-        std::string logoPath = loadingWin->util.getFilePath("data/logo.png");
+        std::string logoPath = loadingWin->util.getFilePath(startupImage);
         SDL_Surface *surface = IMG_Load(logoPath.c_str());
         if (!surface) {
-            mx::system_err << "Error loading logo.png\n";
+            mx::system_err << "Error loading " << startupImage << "\n";
             return;
         }
         
@@ -525,7 +724,7 @@ public:
 #endif
         
         lastUpdateTime = SDL_GetTicks();
-        sprite.initSize(canvasWidth, canvasHeight);
+        quads.setSurface(canvasWidth, canvasHeight);
         loadNewTexture(converted, loadingWin);
         SDL_FreeSurface(converted);
         
@@ -542,6 +741,18 @@ public:
 #endif
     }
 
+    // Appends the effects in data/shaders/index.txt (copies listed in
+    // data/assets.txt read their original) and expands the shared
+    // blocks of every effect.
+    void addLibraryShaders(gl::GLWindow *win) {
+        assets.loadManifest(win->util.getFilePath("data/assets.txt"));
+        library.init(win, win->util.getFilePath("data/shaders/index.txt"), assets);
+        for(size_t i = 0; i < library.getSize(); ++i) {
+            shaderSources.push_back({library.getNameAt(i), library.getShaderAt(i)});
+        }
+        for(auto &info : shaderSources) info.source = expandShaderIncludes(info.source);
+    }
+
     void load(gl::GLWindow *win) override {
         maxWidth = win->w;
         maxHeight = win->h;
@@ -569,15 +780,17 @@ public:
 
 #ifdef __EMSCRIPTEN__   
         currentFileIndex = 0;
-        library.init(win, win->util.getFilePath("data/shaders/index.txt"));
-        for(size_t i = 0; i < library.getSize(); ++i) {
-            shaderSources.push_back({library.getNameAt(i), library.getShaderAt(i)});
-        }
+        addLibraryShaders(win);
         emscripten_async_call([](void* arg) {
             About* self = static_cast<About*>(arg);
             self->loadNextShader();
         }, this, 50);  
-        
+#else
+        addLibraryShaders(win);
+        while(loadingShaderIndex < static_cast<int>(shaderSources.size())) {
+            loadNextShader();
+        }
+        finishLoading();
 #endif
     }
     float cameraYaw = 270.0f;   
@@ -606,6 +819,8 @@ public:
     }
 
     void loadModelFile(const std::string &m_file_path) {
+        loader.cancel();
+        redrawRequested = true;
         if(m_file_path.find("quad") != std::string::npos) {
                 is3d = false;
                 if (texWidth > 0 && texHeight > 0) {
@@ -623,7 +838,7 @@ public:
                         displayX = (canvasWidth - displayW) / 2;
                         displayY = 0;
                     }
-                    sprite.initSize(canvasWidth, canvasHeight);
+                    quads.setSurface(canvasWidth, canvasHeight);
                     if (loadingComplete && loadingWin) {
                         switchShader(currentShaderIndex, loadingWin);
                     }
@@ -632,34 +847,737 @@ public:
         } else {
             is3d = true;
         }
-        model.reset(new mx::Model());
-        if(!model->openModel(m_file_path)) {
-            throw mx::Exception("Could not open model: " + m_file_path);
+        std::string path = assets.resolve(m_file_path);
+        std::string key = assets.key(path);
+        GpuModel *cached = models.find(key);
+        if(!cached) {
+            TRACE_SCOPE_DETAIL("model", "openModel", path);
+            GpuModel loaded;
+            if(!loadGpuModel(path, loaded, quantizeModels)) {
+                throw mx::Exception("Could not open model: " + m_file_path);
+            }
+            cached = models.insert(key, std::move(loaded));
         }
+        model = cached;
+        modelPath = path;
     }
 
-    void drawModel2D(gl::GLWindow *win) {
-        if (currentShaderIndex >= shaders2.size()) {
-            printf("Error: shaders2 index %zu out of bounds (size: %zu)\n", currentShaderIndex, shaders2.size());
+    // Used by the page: the file is read off the render thread and the
+    // current model stays on screen until the new one has been uploaded.
+    // The quad and models already in the cache switch at once.
+    void requestModelFile(const std::string &m_file_path) {
+        if(m_file_path.find("quad") != std::string::npos) {
+            loadModelFile(m_file_path);
+            return;
+        }
+        // Models are cached by content. A name loaded before is found by
+        // the key it was given then; a new name is hashed on the loader
+        // thread and matched against the cache in pollModelLoad.
+        std::string path = assets.resolve(m_file_path);
+        std::string key = assets.knownKey(path);
+        if(GpuModel *cached = key.empty() ? nullptr : models.find(key)) {
+            loader.cancel();
+            model = cached;
+            modelPath = path;
+            is3d = true;
+            redrawRequested = true;
             return;
         }
+        loader.request(path);
+    }
+
+    // Called at the top of a frame; uploads a model the loader has finished.
+    void pollModelLoad() {
+        LoadedModel loaded;
+        if(!loader.poll(loaded)) return;
+        if(!loaded.ok) {
+            mx::system_err << "acmx2: could not open model: " << loaded.path << "\n";
+            return;
+        }
+        std::string key = assets.remember(loaded.path, loaded.hash);
+        GpuModel *cached = models.find(key);
+        if(!cached) {
+            TRACE_SCOPE_DETAIL("model", "upload", loaded.path);
+            GpuModel gpu;
+            if(!loaded.upload(gpu, quantizeModels)) {
+                mx::system_err << "acmx2: could not upload model: " << loaded.path << "\n";
+                return;
+            }
+            cached = models.insert(key, std::move(gpu));
+        }
+        model = cached;
+        modelPath = loaded.path;
+        is3d = true;
+        redrawRequested = true;
+        mx::system_out << "acmx2: loaded " << loaded.path << " in " << loaded.ms << " ms\n";
+    }
+
+    // The 3D program for the current effect. Quantized models and
+    // instance fields need the effect linked with another vertex stage,
+    // which is compiled the first time it is drawn; if that fails, the
+    // feature is switched off.
+    gl::ShaderProgram *program3D() {
+        int variant = (model && model->quantized ? 1 : 0) | (model && instanceCount > 0 ? 2 : 0);
+        if(variant == 0 || currentShaderIndex >= fragmentSources.size()) return shaders[currentShaderIndex].get();
+        auto &programs = shaderVariants[variant - 1];
+        if(programs.size() < shaders.size()) programs.resize(shaders.size());
+        auto &linked = programs[currentShaderIndex];
+        if(!linked) {
+            auto program = std::make_unique<gl::ShaderProgram>();
+            const std::string &fragment = fragmentSources[currentShaderIndex];
+            std::string vertex = vertexVariant(variant);
+            bool ok = (variant & 2) && program->loadProgramFromText(vertex.c_str(), instanceFragmentSource(fragment).c_str());
+            // Effects that reuse the name time_f keep one time for all copies.
+            if(!ok) {
+                program = std::make_unique<gl::ShaderProgram>();
+                ok = program->loadProgramFromText(vertex.c_str(), fragment.c_str());
+            }
+            if(!ok) {
+                if(variant & 2) {
+                    mx::system_err << "acmx2: instanced vertex path failed to compile; drawing a single model\n";
+                    setModelInstances(0, 0.0f);
+                } else {
+                    mx::system_err << "acmx2: quantized vertex path failed to compile; using full-precision models\n";
+                    setModelQuantization(false);
+                }
+                return program3D();
+            }
+            program->setSilent(true);
+            linked = std::move(program);
+        }
+        return linked.get();
+    }
+
+    // Uploads models as PackedVertex from now on; cached models are
+    // dropped and the current one is uploaded again in the new layout.
+    // This runs mid-frame when program3D falls back, so a model that no
+    // longer loads is reported and left out rather than thrown.
+    void setModelQuantization(bool value) {
+        if(value == quantizeModels) return;
+        quantizeModels = value;
+        models.clear();
+        model = nullptr;
+        if(!modelPath.empty()) {
+            bool was3d = is3d;
+            try {
+                loadModelFile(modelPath);
+            } catch (mx::Exception &e) {
+                mx::system_err << "acmx2: " << e.text() << "\n";
+            }
+            is3d = was3d;
+        }
+    }
+
+    bool getModelQuantization() const { return quantizeModels; }
+
+    void drawQuad(gl::ShaderProgram *program, GLuint tex, int x, int y, int w, int h) {
         glDisable(GL_DEPTH_TEST);
-        gl::ShaderProgram *activeShader = shaders2[currentShaderIndex].get();
-        activeShader->setUniform("mv_matrix", glm::mat4(1.0f));
-        activeShader->setUniform("proj_matrix", glm::mat4(1.0f));
+        program->setUniform("mv_matrix", glm::mat4(1.0f));
+        program->setUniform("proj_matrix", glm::mat4(1.0f));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindTexture(GL_TEXTURE_2D, tex);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        sprite.setShader(activeShader);
-        sprite.setName("textTexture");
-        sprite.draw(texture, displayX, displayY, displayW, displayH);
+        FRAME_PHASE(FramePhase::DrawSubmit);
+        TRACE_SCOPE("render", "drawQuad");
+        quads.draw(program->id(), x, y, w, h);
+    }
+
+    void drawModel2D(gl::GLWindow *win) {
+        if (currentShaderIndex >= shaders2.size()) {
+            printf("Error: shaders2 index %zu out of bounds (size: %zu)\n", currentShaderIndex, shaders2.size());
+            return;
+        }
+        drawQuad(shaders2[currentShaderIndex].get(), texture, displayX, displayY, displayW, displayH);
+    }
+
+    static constexpr int OPACITY_PROBE_SIZE = 8;
+
+    // Draws the effect once into a small target and checks that it wrote
+    // alpha 1 everywhere.
+    bool probeOpaque(size_t index) {
+        RenderTarget *target = targetPool.acquire(OPACITY_PROBE_SIZE, OPACITY_PROBE_SIZE, GL_RGBA8, false);
+        if(!target) return false;
+        GLint output = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        gl::ShaderProgram *program = shaders2[index].get();
+        program->useProgram();
+        setFrameUniforms(program, 0.0f);
+        program->setUniform("iResolution", glm::vec2(OPACITY_PROBE_SIZE, OPACITY_PROBE_SIZE));
+        target->bind();
+        glDisable(GL_BLEND);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        quads.setSurface(OPACITY_PROBE_SIZE, OPACITY_PROBE_SIZE);
+        drawQuad(program, texture, 0, 0, OPACITY_PROBE_SIZE, OPACITY_PROBE_SIZE);
+        unsigned char pixels[OPACITY_PROBE_SIZE * OPACITY_PROBE_SIZE * 4];
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, OPACITY_PROBE_SIZE, OPACITY_PROBE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        targetPool.release(target);
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        glViewport(0, 0, canvasWidth, canvasHeight);
+        quads.setSurface(canvasWidth, canvasHeight);
+        for(size_t i = 3; i < sizeof(pixels); i += 4) {
+            if(pixels[i] != 255) return false;
+        }
+        return true;
+    }
+
+    // Only effects that read no time, mouse or feedback uniforms are
+    // probed; their output is fixed by the image and the sliders, so the
+    // result holds until one of those changes.
+    bool effectOpaque(size_t index) {
+        if(index >= uniformUse.size() || uniformUse[index] != UNIFORM_USE_NONE) return false;
+        uint64_t key = sliderKey();
+        if(opacity.size() != shaders2.size() || key != opacityKey) {
+            opacity.assign(shaders2.size(), -1);
+            opacityKey = key;
+        }
+        if(index >= opacity.size()) return false;
+        if(opacity[index] < 0) opacity[index] = probeOpaque(index) ? 1 : 0;
+        return opacity[index] == 1;
+    }
+
+    void clearLetterbox() {
+        int bottom = canvasHeight - displayY - displayH;
+        int top = bottom + displayH;
+        auto clearRect = [](int x, int y, int w, int h) {
+            if(w <= 0 || h <= 0) return;
+            glScissor(x, y, w, h);
+            glClear(GL_COLOR_BUFFER_BIT);
+        };
+        glEnable(GL_SCISSOR_TEST);
+        clearRect(0, 0, displayX, canvasHeight);
+        clearRect(displayX + displayW, 0, canvasWidth - displayX - displayW, canvasHeight);
+        clearRect(displayX, 0, displayW, bottom);
+        clearRect(displayX, top, displayW, canvasHeight - top);
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    // Sets up the window framebuffer for the frame. 3D clears colour and
+    // depth as before. 2D never touches depth, and when every effect drawn
+    // is opaque blending is turned off and only the letterbox bars are
+    // cleared, since the display rect is overwritten anyway.
+    void beginFrame() {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        opaqueFrame = false;
+        if(!loadingComplete || is3d) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glEnable(GL_DEPTH_TEST);
+            return;
+        }
+        glDisable(GL_DEPTH_TEST);
+        if(browsing) return;
+        opaqueFrame = effectOpaque(currentShaderIndex) && std::all_of(chain.begin(), chain.end(), [this](size_t pass) { return effectOpaque(pass); });
+        if(opaqueFrame) {
+            clearLetterbox();
+        } else {
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+    }
+
+    // The window's depth buffer is not used by a 2D frame; letting the
+    // driver discard it saves storing it back on tiled GPUs. Only the web
+    // build does this: glInvalidateFramebuffer needs GL 4.3 natively.
+    void endFrame() {
+#ifdef __EMSCRIPTEN__
+        if(!loadingComplete || is3d) return;
+        GLint output = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        if(output != 0) return;
+        GLenum attachments[] = { GL_DEPTH, GL_STENCIL };
+        glInvalidateFramebuffer(GL_FRAMEBUFFER, 2, attachments);
+#endif
+    }
+
+    // Renders the current effect into a pooled target scaled by renderScale,
+    // then runs each chained 2D effect over the previous result, alternating
+    // between two targets. The last pass draws straight into whatever
+    // framebuffer was bound; with no chain the target is blitted up instead.
+    // In feedback mode the final image lands in one of two history targets
+    // and the other, last frame's, is bound as iPrevFrame on unit 1; the two
+    // swap roles every frame so history is never copied.
+    void drawOffscreen(gl::GLWindow *win, float deltaTime) {
+        TRACE_SCOPE("render", "drawOffscreen");
+        GLint output = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        int sceneX = is3d ? 0 : displayX;
+        int sceneY = is3d ? 0 : displayY;
+        int sceneW = is3d ? canvasWidth : displayW;
+        int sceneH = is3d ? canvasHeight : displayH;
+        int targetW = std::max(1, static_cast<int>(sceneW * renderScale + 0.5f));
+        int targetH = std::max(1, static_cast<int>(sceneH * renderScale + 0.5f));
+        RenderTarget *result = nullptr;
+        if(feedbackEnabled) {
+            if(!prepareFeedback(targetW, targetH)) {
+                mx::system_err << "acmx2: feedback disabled, could not allocate history targets\n";
+                feedbackEnabled = false;
+            } else {
+                result = &feedback[feedbackIndex];
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, feedback[1 - feedbackIndex].getTexture());
+                glActiveTexture(GL_TEXTURE0);
+            }
+        }
+        RenderTarget *src = (result && chain.empty()) ? result : targetPool.acquire(targetW, targetH, GL_RGBA8, is3d);
+        RenderTarget *dst = chain.size() > 1 ? targetPool.acquire(targetW, targetH, GL_RGBA8, false) : nullptr;
+        if(!src || (chain.size() > 1 && !dst)) {
+            if(src && src != result) targetPool.release(src);
+            if(dst) targetPool.release(dst);
+            mx::system_err << "acmx2: offscreen rendering disabled, could not allocate render targets\n";
+            chain.clear();
+            scaler.setEnabled(false);
+            return;
+        }
+        src->bind();
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | (is3d ? GL_DEPTH_BUFFER_BIT : 0));
+        if(is3d) {
+            drawModel(win, targetH);
+        } else {
+            quads.setSurface(targetW, targetH);
+            drawQuad(shaders2[currentShaderIndex].get(), texture, 0, 0, targetW, targetH);
+        }
+        for(size_t i = 0; i < chain.size(); ++i) {
+            gl::ShaderProgram *program = shaders2[chain[i]].get();
+            program->useProgram();
+            setFrameUniforms(program, deltaTime);
+            if(i + 1 == chain.size() && !result) {
+                glBindFramebuffer(GL_FRAMEBUFFER, output);
+                glViewport(0, 0, canvasWidth, canvasHeight);
+                quads.setSurface(canvasWidth, canvasHeight);
+                drawQuad(program, src->getTexture(), sceneX, sceneY, sceneW, sceneH);
+            } else {
+                RenderTarget *next = (i + 1 == chain.size()) ? result : dst;
+                next->bind();
+                // Pooled targets keep an earlier pass's image, which a
+                // blended pass would otherwise draw over.
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+                quads.setSurface(targetW, targetH);
+                drawQuad(program, src->getTexture(), 0, 0, targetW, targetH);
+                if(next == dst) std::swap(src, dst);
+            }
+        }
+        RenderTarget *shown = result ? result : (chain.empty() ? src : nullptr);
+        if(shown) {
+            int bottom = canvasHeight - sceneY - sceneH;
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, shown->getFramebuffer());
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+            glBlitFramebuffer(0, 0, targetW, targetH, sceneX, bottom, sceneX + sceneW, bottom + sceneH, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            glBindFramebuffer(GL_FRAMEBUFFER, output);
+            glViewport(0, 0, canvasWidth, canvasHeight);
+        }
+        if(src != result) targetPool.release(src);
+        if(dst) targetPool.release(dst);
+        if(result) feedbackIndex = 1 - feedbackIndex;
+    }
+
+    // (Re)creates both history targets when the render size or mode changes;
+    // history starts out black.
+    bool prepareFeedback(int w, int h) {
+        RenderTarget &t = feedback[0];
+        if(t.valid() && t.getWidth() == w && t.getHeight() == h && t.getHasDepth() == is3d && feedback[1].valid()) {
+            return true;
+        }
+        for(auto &target : feedback) {
+            if(!target.create(w, h, is3d)) return false;
+            target.bind();
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        feedbackIndex = 0;
+        return true;
+    }
+
+    void setFeedback(bool value) {
+        feedbackEnabled = value;
+        redrawRequested = true;
+        if(!value) {
+            for(auto &target : feedback) target.release();
+        }
+    }
+
+    bool getFeedback() const { return feedbackEnabled; }
+
+    // Everything besides time that can change a 2D frame. The mouse only
+    // counts when the effect, or a pass chained after it, reads it.
+    std::array<float, 25> frameInputs() const {
+        uint32_t use = frameUniformUse();
+        glm::vec4 m = (use & UNIFORM_USE_MOUSE) ? mouse : glm::vec4(0.0f);
+        GLuint program = currentShaderIndex < shaders2.size() ? shaders2[currentShaderIndex]->id() : 0;
+        return { iFrequency, iAmplitude, iHueShift, iSaturation, iBrightness, iContrast, iZoom, iRotation,
+                 iDebugMode, iQuality, iCameraPos.x, iCameraPos.y, iCameraPos.z,
+                 static_cast<float>(canvasWidth), static_cast<float>(canvasHeight),
+                 static_cast<float>(displayX), static_cast<float>(displayY),
+                 static_cast<float>(displayW), static_cast<float>(displayH),
+                 static_cast<float>(currentShaderIndex), static_cast<float>(program),
+                 m.x, m.y, m.z, m.w };
+    }
+
+    uint32_t frameUniformUse() const {
+        uint32_t use = currentShaderIndex < uniformUse.size() ? uniformUse[currentShaderIndex] : UNIFORM_USE_ALL;
+        for(size_t pass : chain) {
+            use |= pass < uniformUse.size() ? uniformUse[pass] : UNIFORM_USE_ALL;
+        }
+        return use;
+    }
+
+    // A frame can be skipped when the image would come out identical: 2D
+    // mode (3D keeps rotating), no timing controller that needs samples,
+    // and an effect that reads neither time nor the previous frame.
+    bool needsRedraw() const {
+        if(!idleSkipping || !loadingComplete) return true;
+        if(redrawRequested || captureNextFrame || is3d || browsing || loader.busy()) return true;
+        if(scaler.isEnabled() || governor.isEnabled()) return true;
+        if(frameUniformUse() & (UNIFORM_USE_TIME | UNIFORM_USE_PREV_FRAME)) return true;
+        return frameInputs() != drawnInputs;
+    }
+
+    // Keeps the clock current while idle so the next drawn frame does not
+    // see the whole idle period as one iTimeDelta.
+    void skipFrame() {
+        lastUpdateTime = SDL_GetTicks();
+    }
+
+    void setIdleSkipping(bool value) {
+        idleSkipping = value;
+        redrawRequested = true;
+    }
+
+    static constexpr int THUMBNAIL_WIDTH = 160;
+    static constexpr int THUMBNAIL_HEIGHT = 90;
+    static constexpr size_t THUMBNAIL_MAX_CELLS = 16;
+
+    bool thumbnailAnimated(size_t index) const {
+        return index >= uniformUse.size() || (uniformUse[index] & (UNIFORM_USE_TIME | UNIFORM_USE_PREV_FRAME)) != 0;
+    }
+
+    // The image and the slider values.
+    uint64_t sliderKey() const {
+        float values[] = { iFrequency, iAmplitude, iHueShift, iSaturation, iBrightness, iContrast, iZoom, iRotation, iDebugMode, iQuality };
+        return fnv1a(values, sizeof(values), textureHash);
+    }
+
+    // Identifies what a static thumbnail depends on: the image, the
+    // sliders, the effect list and the cell size.
+    uint64_t thumbnailKey() const {
+        uint64_t key = sliderKey();
+        for(const auto &name : shader_names) key = fnv1a(name.data(), name.size() + 1, key);
+        int cell[] = { THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, static_cast<int>(shaders2.size()) };
+        return fnv1a(cell, sizeof(cell), key);
+    }
+
+    bool createThumbnails() {
+        size_t count = shaders2.size();
+        float aspect = static_cast<float>(canvasWidth) / static_cast<float>(canvasHeight);
+        int cols = static_cast<int>(std::ceil(std::sqrt(count * aspect * THUMBNAIL_HEIGHT / THUMBNAIL_WIDTH)));
+        if(!thumbs.create(count, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, cols)) {
+            mx::system_err << "acmx2: could not allocate thumbnail atlas\n";
+            return false;
+        }
+        thumbnailKeyValue = thumbnailKey();
+#ifndef __EMSCRIPTEN__
+        if(!thumbnailCache.empty()) {
+            size_t restored = thumbs.load(thumbnailCache, thumbnailKeyValue, [this](size_t i) { return !thumbnailAnimated(i); });
+            mx::system_out << "acmx2: restored " << restored << " cached thumbnails\n";
+        }
+#endif
+        return true;
+    }
+
+    void renderThumbnail(size_t index, float deltaTime) {
+        gl::ShaderProgram *program = shaders2[index].get();
+        program->useProgram();
+        setFrameUniforms(program, deltaTime);
+        program->setUniform("iResolution", glm::vec2(thumbs.getCellWidth(), thumbs.getCellHeight()));
+        drawQuad(program, texture, 0, 0, thumbs.getCellWidth(), thumbs.getCellHeight());
+    }
+
+    // Updates a few atlas cells, then shows the whole atlas fitted to the
+    // canvas.
+    void drawThumbnails(float deltaTime) {
+        TRACE_SCOPE("render", "drawThumbnails");
+        GLint output = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        if((!thumbs.valid() || thumbs.size() != shaders2.size()) && !createThumbnails()) {
+            browsing = false;
+            return;
+        }
+        uint64_t key = thumbnailKey();
+        if(key != thumbnailKeyValue) {
+            thumbnailKeyValue = key;
+            thumbs.invalidate();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, thumbs.getTarget().getFramebuffer());
+        quads.setSurface(thumbs.getCellWidth(), thumbs.getCellHeight());
+        thumbs.update(thumbnailBudgetMs, THUMBNAIL_MAX_CELLS,
+                      [&](size_t i) { renderThumbnail(i, deltaTime); },
+                      [&](size_t i) { return thumbnailAnimated(i); });
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        glViewport(0, 0, canvasWidth, canvasHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        atlasScale = std::min(static_cast<float>(canvasWidth) / thumbs.getWidth(), static_cast<float>(canvasHeight) / thumbs.getHeight());
+        int w = static_cast<int>(thumbs.getWidth() * atlasScale);
+        int h = static_cast<int>(thumbs.getHeight() * atlasScale);
+        atlasX = (canvasWidth - w) / 2;
+        atlasY = (canvasHeight - h) / 2;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, thumbs.getTarget().getFramebuffer());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+        glBlitFramebuffer(0, 0, thumbs.getWidth(), thumbs.getHeight(), atlasX, atlasY, atlasX + w, atlasY + h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+    }
+
+    // Mouse position (bottom-up, as stored in mouse) to effect index.
+    int thumbnailAt(float x, float y) const {
+        if(!browsing || !thumbs.valid()) return -1;
+        return thumbs.cellAt((x - atlasX) / atlasScale, (y - atlasY) / atlasScale);
+    }
+
+    void setShaderBrowser(bool value) {
+        browsing = value && loadingComplete && !shaders2.empty();
+        redrawRequested = true;
     }
 
+    bool getShaderBrowser() const { return browsing; }
+    void setThumbnailBudget(double ms) { if(ms > 0.0) thumbnailBudgetMs = ms; }
+#ifndef __EMSCRIPTEN__
+    void setThumbnailCache(const std::string &filename) { thumbnailCache = filename; }
 
-    void drawModel(gl::GLWindow *win) {
+    bool saveThumbnailCache() {
+        if(thumbnailCache.empty() || !thumbs.valid()) return false;
+        return thumbs.save(thumbnailCache, thumbnailKeyValue, [this](size_t i) { return !thumbnailAnimated(i); });
+    }
+#endif
+
+    bool getIdleSkipping() const { return idleSkipping; }
+
+    static constexpr double LOOP_BUILD_BUDGET_MS = 8.0;
+
+    // Loop playback covers the plain 2D path; chains, feedback and 3D keep
+    // rendering live.
+    bool useLoopCache() const {
+        return loopMode && !is3d && chain.empty() && !feedbackEnabled;
+    }
+
+    // Everything a cached loop depends on besides time. The mouse only
+    // counts for effects that read it.
+    uint64_t loopKey() const {
+        float values[] = { iFrequency, iAmplitude, iHueShift, iSaturation, iBrightness, iContrast, iZoom, iRotation, iDebugMode, iQuality, loopScale };
+        uint64_t key = fnv1a(values, sizeof(values), textureHash);
+        int state[] = { static_cast<int>(currentShaderIndex), static_cast<int>(shaders2[currentShaderIndex]->id()), displayW, displayH };
+        key = fnv1a(state, sizeof(state), key);
+        if(frameUniformUse() & UNIFORM_USE_MOUSE) key = fnv1a(&mouse, sizeof(mouse), key);
+        double timing[] = { loopPeriod, loopFps };
+        return fnv1a(timing, sizeof(timing), key);
+    }
+
+    // Renders loop frames at fixed time steps until the cache is full or
+    // LOOP_BUILD_BUDGET_MS is spent, then restores the live clock.
+    void buildLoopFrames(float deltaTime) {
+        TRACE_SCOPE("render", "buildLoopFrames");
+        GLint output = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        int w = loopCache.getWidth(), h = loopCache.getHeight();
+        RenderTarget *target = targetPool.acquire(w, h, GL_RGBA8, false);
+        if(!target) {
+            mx::system_err << "acmx2: loop cache disabled, could not allocate render target\n";
+            loopMode = false;
+            loopCache.clear();
+            return;
+        }
+        gl::ShaderProgram *program = shaders2[currentShaderIndex].get();
+        float liveTime = animation, liveScale = renderScale;
+        renderScale = loopScale;
+        target->bind();
+        quads.setSurface(w, h);
+        auto start = std::chrono::steady_clock::now();
+        while(loopCache.isBuilding()) {
+            animation = loopCache.nextTime();
+            updateClock();
+            setFrameUniforms(program, static_cast<float>(1.0 / loopFps));
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            drawQuad(program, texture, 0, 0, w, h);
+            if(!loopCache.capture(*target)) {
+                mx::system_err << "acmx2: loop does not fit in " << (loopBudget >> 20) << " MB, rendering live\n";
+                break;
+            }
+            if(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= LOOP_BUILD_BUDGET_MS) break;
+        }
+        if(loopCache.isReady()) {
+            mx::system_out << "acmx2: cached " << loopCache.getFrameCount() << " loop frames in " << (loopCache.getBytes() >> 10) << " KB\n";
+        }
+        animation = liveTime;
+        renderScale = liveScale;
+        updateClock();
+        targetPool.release(target);
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        glViewport(0, 0, canvasWidth, canvasHeight);
+        quads.setSurface(canvasWidth, canvasHeight);
+        setFrameUniforms(program, deltaTime);
+    }
+
+    // Shows the cached frame for the current time. Returns false when the
+    // frame has to be drawn live: while the cache is filling, after it ran
+    // out of budget, or when it could not be created.
+    bool drawLooped(float deltaTime) {
+        TRACE_SCOPE("render", "drawLooped");
+        uint64_t key = loopKey();
+        if(!loopCache.isActive() || loopCache.getKey() != key) {
+            int w = std::max(1, static_cast<int>(displayW * loopScale + 0.5f));
+            int h = std::max(1, static_cast<int>(displayH * loopScale + 0.5f));
+            if(!loopCache.begin(w, h, loopPeriod, loopFps, loopBudget, key)) {
+                mx::system_err << "acmx2: loop cache disabled, could not allocate playback target\n";
+                loopMode = false;
+                loopCache.clear();
+                return false;
+            }
+        }
+        if(loopCache.isBuilding()) buildLoopFrames(deltaTime);
+        if(!loopCache.isReady() || !loopCache.present(animation)) return false;
+        GLint output = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        int bottom = canvasHeight - displayY - displayH;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, loopCache.getPlayback().getFramebuffer());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+        glBlitFramebuffer(0, 0, loopCache.getWidth(), loopCache.getHeight(), displayX, bottom, displayX + displayW, bottom + displayH, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        return true;
+    }
+
+    // period is in animation seconds (iTime), so it matches the constant
+    // the effect loops on, e.g. pingPong(time, 15.0).
+    bool setLoopCache(bool enabled, double period, double fps) {
+        loopCache.clear();
+        loopMode = false;
+        if(!enabled) return true;
+        if(period <= 0.0 || fps <= 0.0) return false;
+        loopPeriod = period;
+        loopFps = fps;
+        loopMode = true;
+        return true;
+    }
+
+    void setLoopCacheLimits(float scale, int megabytes) {
+        if(scale > 0.0f) loopScale = std::min(1.0f, scale);
+        if(megabytes > 0) loopBudget = static_cast<size_t>(megabytes) << 20;
+        loopCache.clear();
+    }
+
+    bool getLoopCache() const { return loopMode; }
+    std::string getLoopCacheStatus() const { return loopCache.toJSON(); }
+
+    bool addChainPass(int index) {
+        if(index < 0 || index >= static_cast<int>(shaders2.size())) {
+            return false;
+        }
+        chain.push_back(index);
+        redrawRequested = true;
+        return true;
+    }
+
+    void clearChain() {
+        chain.clear();
+        redrawRequested = true;
+        targetPool.trim();
+    }
+
+    int getChainLength() const { return static_cast<int>(chain.size()); }
+
+    // Quality is lowered first; resolution only drops once quality is at its
+    // floor, and while the resolution is reduced it alone recovers, so the
+    // two controllers never pull against each other.
+    void addFrameCost(double ms) {
+        bool governed = governor.isEnabled() && !(scaler.isEnabled() && scaler.getScale() < scaler.getMaxScale());
+        if(governed && governor.addSample(ms)) {
+            iQuality = governor.getQuality();
+        }
+        if(scaler.isEnabled() && (!governed || governor.atFloor())) {
+            scaler.addSample(ms);
+        }
+    }
+
+    void setDynamicResolution(bool value) {
+        if(value) gpuClock.init();
+        scaler.setEnabled(value);
+    }
+
+    bool getDynamicResolution() const { return scaler.isEnabled(); }
+
+    void setQualityGovernor(bool value) {
+        if(value == governor.isEnabled()) return;
+        if(value) {
+            gpuClock.init();
+            governor.setCeiling(iQuality);
+            governor.setEnabled(true);
+            if(currentShaderIndex < shaders.size()) {
+                iQuality = governor.select(currentShaderIndex < shader_names.size() ? shader_names[currentShaderIndex] : "custom");
+            }
+        } else {
+            governor.setEnabled(false);
+            iQuality = governor.getCeiling();
+        }
+    }
+
+    bool getQualityGovernor() const { return governor.isEnabled(); }
+    std::string getQualitySettings() const { return governor.serialize(); }
+    void setQualitySettings(const std::string &text) { governor.deserialize(text); }
+    bool loadQualitySettings(const std::string &filename) { return governor.load(filename); }
+    bool saveQualitySettings(const std::string &filename) const { return governor.save(filename); }
+
+    void setTargetFrameTime(double ms) {
+        scaler.setTargetMs(ms);
+        governor.setTargetMs(ms);
+    }
+    void setResolutionScaleRange(float minScale, float maxScale) { scaler.setRange(minScale, maxScale); }
+    float getRenderScale() const { return renderScale; }
+
+    // The current model is always the most recently used entry, so
+    // eviction never takes it.
+    void setModelCacheBudget(size_t bytes) { models.setBudget(bytes); }
+
+    // Largest error, in pixels, a level of detail may show; 0 always draws
+    // the full meshes.
+    void setLodThreshold(float pixels) {
+        lodThreshold = std::max(0.0f, pixels);
+        redrawRequested = true;
+    }
+
+    // Draws count copies of the model around the camera instead of one;
+    // each copy's effect time is offset by up to timeSpread seconds.
+    void setModelInstances(size_t count, float timeSpread) {
+        instanceCount = count;
+        instanceTimeSpread = std::max(0.0f, timeSpread);
+        instances.clear();
+        instanceModel = nullptr;
+        redrawRequested = true;
+    }
+
+    std::string getModelLodStats() const {
+        std::ostringstream out;
+        out << "{\"threshold\": " << lodThreshold << ", \"triangles\": " << lodTriangles << ", \"culled\": " << meshesCulled << ", \"drawCalls\": " << modelDrawCalls
+            << ", \"instances\": " << instanceCount << ", \"instancesDrawn\": " << (instanceCount ? instanceStats.drawn : 0) << ", \"meshesPerLevel\": [";
+        for(size_t i = 0; i < lodLevels.size(); ++i) out << (i ? ", " : "") << lodLevels[i];
+        out << "]}";
+        return out.str();
+    }
+    std::string getModelCacheStats() const { return models.toJSON(); }
+
+    int findShader(const std::string &name) const {
+        for(size_t i = 0; i < shader_names.size(); ++i) {
+            if(shader_names[i] == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+
+    // targetHeight is the height in pixels of what is drawn into, which is
+    // smaller than the window when drawOffscreen renders at a reduced scale.
+    void drawModel(gl::GLWindow *win, int targetHeight) {
         glEnable(GL_DEPTH_TEST);
         glDepthFunc(GL_LESS);
         glDepthMask(GL_TRUE);
@@ -742,17 +1660,22 @@ public:
         glm::vec3 cameraTarget = cameraPos + lookDirection;
         glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
         glm::mat4 viewMatrix = glm::lookAt(cameraPos, cameraTarget, cameraUp);
+        const float fovY = glm::radians(120.0f);
         glm::mat4 projectionMatrix = glm::perspective(
-            glm::radians(120.0f),
+            fovY,
             static_cast<float>(win->w) / static_cast<float>(win->h),
             0.01f,
             1000.0f
         );
         glm::mat4 mvMatrix = viewMatrix * modelMatrix;
         gl::ShaderProgram *activeShader;
-        activeShader = shaders[currentShaderIndex].get();
+        activeShader = program3D();
         activeShader->setUniform("mv_matrix", mvMatrix);
         activeShader->setUniform("proj_matrix", projectionMatrix);
+        if(model && model->quantized) {
+            activeShader->setUniform("posScale", glm::vec3(model->posScale[0], model->posScale[1], model->posScale[2]));
+            activeShader->setUniform("posBias", glm::vec3(model->posBias[0], model->posBias[1], model->posBias[2]));
+        }
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -760,102 +1683,118 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glUniform1i(glGetUniformLocation(activeShader->id(), "textTexture"), 0);
-        model->setShaderProgram(activeShader);    
-        for(auto &m : model->meshes) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);    
-            m.draw();
+        FRAME_PHASE(FramePhase::DrawSubmit);
+        TRACE_SCOPE("render", "drawModel");
+        if(!model) return;
+        lodLevels.fill(0);
+        lodTriangles = 0;
+        // Pixels one model unit covers at the near side of each mesh's
+        // bounding sphere; inside the sphere the full mesh is drawn.
+        float pixelScale = static_cast<float>(targetHeight) / (2.0f * tanf(fovY * 0.5f));
+        glm::mat4 clipMatrix = projectionMatrix * mvMatrix;
+        Frustum frustum(&clipMatrix[0][0]);
+        if(instanceCount > 0) {
+            if(instanceModel != model || instancePath != modelPath || instances.size() != instanceCount) {
+                instances.build(*model, instanceCount, instanceTimeSpread);
+                instanceModel = model;
+                instancePath = modelPath;
+            }
+            instanceStats = instances.draw(*model, frustum, &cameraPos[0], pixelScale, lodThreshold);
+            for(size_t l = 0; l < lodLevels.size(); ++l) lodLevels[l] = instanceStats.perLevel[l] * model->meshes.size();
+            lodTriangles = instanceStats.triangles;
+            meshesCulled = instanceStats.culled * model->meshes.size();
+            modelDrawCalls = instanceStats.calls;
+            FRAME_STATS_MESHES(static_cast<uint32_t>(instanceStats.drawn * model->meshes.size()), static_cast<uint32_t>(meshesCulled));
+            glFrontFace(GL_CCW);
+            return;
         }
+        meshesCulled = cullMeshes(frustum, model->bounds, meshVisible);
+        meshLevels.resize(model->meshes.size());
+        for(size_t i = 0; i < model->meshes.size(); ++i) {
+            const GpuMesh &m = model->meshes[i];
+            if(!meshVisible[i]) {
+                meshLevels[i] = -1;
+                continue;
+            }
+            int level = 0;
+            if(lodThreshold > 0.0f) {
+                float distance = glm::length(cameraPos - glm::vec3(m.center[0], m.center[1], m.center[2])) - m.radius;
+                if(distance > 0.01f) level = m.selectLevel(pixelScale / distance, lodThreshold);
+            }
+            lodLevels[level]++;
+            lodTriangles += m.levelCount[level] / 3;
+            meshLevels[i] = level;
+        }
+        modelDrawCalls = model->draw(meshLevels.data());
+        FRAME_STATS_MESHES(static_cast<uint32_t>(model->meshes.size() - meshesCulled), static_cast<uint32_t>(meshesCulled));
         glFrontFace(GL_CCW);
     }
   
+    // Values derived from animation.
+    void updateClock() {
+        beatValue = 0.5f + 0.5f * sinf(animation * 2.0f * M_PI);
+        audioLevel = 0.3f + 0.7f * (0.5f + 0.5f * sinf(animation * 0.5f));
+        iSeconds = fmodf(animation, 60.0f);
+        iMinutes = fmodf(animation / 60.0f, 60.0f);
+        iHours = fmodf(animation / 3600.0f, 24.0f);
+    }
+
+    void setFrameUniforms(gl::ShaderProgram *program, float deltaTime) {
+        FRAME_PHASE(FramePhase::Uniforms);
+        TRACE_SCOPE("render", "uniforms");
+        program->setUniform("time_f", animation);
+        program->setUniform("iTime", animation);
+        program->setUniform("iTimeDelta", deltaTime);
+        program->setUniform("iFrame", static_cast<float>(frameCount));
+        program->setUniform("iSeconds", iSeconds);
+        program->setUniform("iMinutes", iMinutes);
+        program->setUniform("iHours", iHours);
+        program->setUniform("iResolution", glm::vec2(displayW, displayH) * renderScale);
+        glm::vec4 adjMouse = mouse;
+        adjMouse.x = (adjMouse.x - displayX) * renderScale;
+        adjMouse.y = (adjMouse.y - displayY) * renderScale;
+        program->setUniform("iMouse", adjMouse);
+        program->setUniform("iMouseNormalized", glm::vec2(adjMouse.x / (displayW * renderScale), 1.0f - adjMouse.y / (displayH * renderScale)));
+        program->setUniform("iMouseActive", mouse.z > 0.5f ? 1.0f : 0.0f);
+        program->setUniform("iMouseVelocity", iMouseVelocity);
+        program->setUniform("iMouseClick", iMouseClick);
+        program->setUniform("iAspectRatio", static_cast<float>(displayW) / static_cast<float>(displayH));
+        program->setUniform("iSpeed", iSpeed);
+        program->setUniform("iFrequency", iFrequency);
+        program->setUniform("iAmplitude", iAmplitude);
+        program->setUniform("iHueShift", iHueShift);
+        program->setUniform("iSaturation", iSaturation);
+        program->setUniform("iBrightness", iBrightness);
+        program->setUniform("iContrast", iContrast);
+        program->setUniform("iZoom", iZoom);
+        program->setUniform("iRotation", iRotation);
+        program->setUniform("iCameraPos", iCameraPos);
+        program->setUniform("iBeat", beatValue);
+        program->setUniform("iAudioLevel", audioLevel);
+        program->setUniform("iDebugMode", iDebugMode);
+        program->setUniform("iQuality", iQuality);
+        program->setUniform("alpha", 1.0f);
+        program->setUniform("amp", 0.5f);
+        program->setUniform("uamp", 0.5f);
+        program->setUniform("textTexture", 0);
+        program->setUniform("iPrevFrame", 1);
+    }
+  
     void switchShader(size_t index, gl::GLWindow *win) {
         if(index < shaders.size()) {
             currentShaderIndex = index;
+            redrawRequested = true;
+            governor.select(currentShaderIndex < shader_names.size() ? shader_names[currentShaderIndex] : "custom");
+            if(governor.isEnabled()) iQuality = governor.getQuality();
             if(is3d) {
-                shaders[currentShaderIndex]->useProgram();
-                shaders[currentShaderIndex]->setUniform("time_f", animation);
-                shaders[currentShaderIndex]->setUniform("iTime", animation);
-                shaders[currentShaderIndex]->setUniform("iTimeDelta", 0.0f);
-                shaders[currentShaderIndex]->setUniform("iFrame", static_cast<float>(frameCount));
-                shaders[currentShaderIndex]->setUniform("iSeconds", iSeconds);
-                shaders[currentShaderIndex]->setUniform("iMinutes", iMinutes);
-                shaders[currentShaderIndex]->setUniform("iHours", iHours);
-                shaders[currentShaderIndex]->setUniform("iResolution", glm::vec2(displayW, displayH));
-                glm::vec4 adjMouse = mouse;
-                adjMouse.x -= displayX;
-                adjMouse.y -= displayY;
-                shaders[currentShaderIndex]->setUniform("iMouse", adjMouse);
-                shaders[currentShaderIndex]->setUniform("iMouseNormalized", glm::vec2(adjMouse.x / displayW, 1.0f - adjMouse.y / displayH));
-                shaders[currentShaderIndex]->setUniform("iMouseActive", mouse.z > 0.5f ? 1.0f : 0.0f);
-                shaders[currentShaderIndex]->setUniform("iMouseVelocity", iMouseVelocity);
-                shaders[currentShaderIndex]->setUniform("iMouseClick", iMouseClick);
-                shaders[currentShaderIndex]->setUniform("iAspectRatio", static_cast<float>(displayW) / static_cast<float>(displayH));
-                shaders[currentShaderIndex]->setUniform("iSpeed", iSpeed);
-                shaders[currentShaderIndex]->setUniform("iFrequency", iFrequency);
-                shaders[currentShaderIndex]->setUniform("iAmplitude", iAmplitude);
-                shaders[currentShaderIndex]->setUniform("iHueShift", iHueShift);
-                shaders[currentShaderIndex]->setUniform("iSaturation", iSaturation);
-                shaders[currentShaderIndex]->setUniform("iBrightness", iBrightness);
-                shaders[currentShaderIndex]->setUniform("iContrast", iContrast);
-                shaders[currentShaderIndex]->setUniform("iZoom", iZoom);
-                shaders[currentShaderIndex]->setUniform("iRotation", iRotation);
-                shaders[currentShaderIndex]->setUniform("iCameraPos", iCameraPos);
-                shaders[currentShaderIndex]->setUniform("iBeat", beatValue);
-                shaders[currentShaderIndex]->setUniform("iAudioLevel", audioLevel);
-                shaders[currentShaderIndex]->setUniform("iDebugMode", iDebugMode);
-                shaders[currentShaderIndex]->setUniform("iQuality", iQuality);
-                shaders[currentShaderIndex]->setUniform("alpha", 1.0f);
-                shaders[currentShaderIndex]->setUniform("amp", 0.5f);
-                shaders[currentShaderIndex]->setUniform("uamp", 0.5f);
-                shaders[currentShaderIndex]->setUniform("textTexture", 0);
+                program3D()->useProgram();
+                setFrameUniforms(program3D(), 0.0f);
                 glActiveTexture(GL_TEXTURE0);
-                model->setShaderProgram(shaders[currentShaderIndex].get());
                 forceTextureRebind();
-                sprite.initWithTexture(shaders[currentShaderIndex].get(), texture, displayX, displayY, displayW, displayH);
             } else  {
                 shaders2[currentShaderIndex]->useProgram();
-                shaders2[currentShaderIndex]->setUniform("time_f", animation);
-                shaders2[currentShaderIndex]->setUniform("iTime", animation);
-                shaders2[currentShaderIndex]->setUniform("iTimeDelta", 0.0f);
-                shaders2[currentShaderIndex]->setUniform("iFrame", static_cast<float>(frameCount));
-                shaders2[currentShaderIndex]->setUniform("iSeconds", iSeconds);
-                shaders2[currentShaderIndex]->setUniform("iMinutes", iMinutes);
-                shaders2[currentShaderIndex]->setUniform("iHours", iHours);
-                shaders2[currentShaderIndex]->setUniform("iResolution", glm::vec2(displayW, displayH));
-                glm::vec4 adjMouse = mouse;
-                adjMouse.x -= displayX;
-                adjMouse.y -= displayY;
-                shaders2[currentShaderIndex]->setUniform("iMouse", adjMouse);
-                shaders2[currentShaderIndex]->setUniform("iMouseNormalized", glm::vec2(adjMouse.x / displayW, 1.0f - adjMouse.y / displayH));
-                shaders2[currentShaderIndex]->setUniform("iMouseActive", mouse.z > 0.5f ? 1.0f : 0.0f);
-                shaders2[currentShaderIndex]->setUniform("iMouseVelocity", iMouseVelocity);
-                shaders2[currentShaderIndex]->setUniform("iMouseClick", iMouseClick);
-                shaders2[currentShaderIndex]->setUniform("iAspectRatio", static_cast<float>(displayW) / static_cast<float>(displayH));
-                shaders2[currentShaderIndex]->setUniform("iSpeed", iSpeed);
-                shaders2[currentShaderIndex]->setUniform("iFrequency", iFrequency);
-                shaders2[currentShaderIndex]->setUniform("iAmplitude", iAmplitude);
-                shaders2[currentShaderIndex]->setUniform("iHueShift", iHueShift);
-                shaders2[currentShaderIndex]->setUniform("iSaturation", iSaturation);
-                shaders2[currentShaderIndex]->setUniform("iBrightness", iBrightness);
-                shaders2[currentShaderIndex]->setUniform("iContrast", iContrast);
-                shaders2[currentShaderIndex]->setUniform("iZoom", iZoom);
-                shaders2[currentShaderIndex]->setUniform("iRotation", iRotation);
-                shaders2[currentShaderIndex]->setUniform("iCameraPos", iCameraPos);
-                shaders2[currentShaderIndex]->setUniform("iBeat", beatValue);
-                shaders2[currentShaderIndex]->setUniform("iAudioLevel", audioLevel);
-                shaders2[currentShaderIndex]->setUniform("iDebugMode", iDebugMode);
-                shaders2[currentShaderIndex]->setUniform("iQuality", iQuality);
-                shaders2[currentShaderIndex]->setUniform("alpha", 1.0f);
-                shaders2[currentShaderIndex]->setUniform("amp", 0.5f);
-                shaders2[currentShaderIndex]->setUniform("uamp", 0.5f);
-                shaders2[currentShaderIndex]->setUniform("textTexture", 0);
+                setFrameUniforms(shaders2[currentShaderIndex].get(), 0.0f);
                 glActiveTexture(GL_TEXTURE0);
-                sprite.initWithTexture(shaders2[currentShaderIndex].get(), texture, displayX, displayY, displayW, displayH);
             }
         }
     }
@@ -871,10 +1810,20 @@ public:
         mx::system_out << "Switched to shader: " << shaderSources[currentShaderIndex].name << "\n";
     }
 
+    void drawLive(gl::GLWindow *win, float deltaTime) {
+        if(!chain.empty() || renderScale < 1.0f || feedbackEnabled)
+            drawOffscreen(win, deltaTime);
+        else if(is3d)
+            drawModel(win, win->h);
+        else
+            drawModel2D(win);
+    }
+
     void draw(gl::GLWindow *win) override {
         if (!loadingComplete) {
             return;
         }
+        pollModelLoad();
         if (texture != 0) {
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_2D, texture);
@@ -885,99 +1834,42 @@ public:
         }
         
         glDisable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        if(opaqueFrame) {
+            glDisable(GL_BLEND);
+        } else {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
         Uint32 currentTime = SDL_GetTicks();
         float deltaTime = (currentTime - lastUpdateTime) / 1000.0f;
         lastUpdateTime = currentTime;
         animation += deltaTime * iSpeed;
         frameCount++;
-        beatValue = 0.5f + 0.5f * sinf(animation * 2.0f * M_PI);
-        audioLevel = 0.3f + 0.7f * (0.5f + 0.5f * sinf(animation * 0.5f));
-        iSeconds = fmodf(animation, 60.0f);
-        iMinutes = fmodf(animation / 60.0f, 60.0f);
-        iHours = fmodf(animation / 3600.0f, 24.0f);
+        updateClock();
         glm::vec2 currentMousePos(mouse.x, mouse.y);
         iMouseVelocity = currentMousePos - prevMousePos;
         prevMousePos = currentMousePos;
         iMouseClick = mouse.z > 0.5f ? 1.0f : 0.0f;
-        if(is3d) {
-            shaders[currentShaderIndex]->useProgram();
-            shaders[currentShaderIndex]->setUniform("time_f", animation);
-            shaders[currentShaderIndex]->setUniform("iTime", animation);
-            shaders[currentShaderIndex]->setUniform("iTimeDelta", deltaTime);
-            shaders[currentShaderIndex]->setUniform("iFrame", static_cast<float>(frameCount));
-            shaders[currentShaderIndex]->setUniform("iSeconds", iSeconds);
-            shaders[currentShaderIndex]->setUniform("iMinutes", iMinutes);
-            shaders[currentShaderIndex]->setUniform("iHours", iHours);
-            shaders[currentShaderIndex]->setUniform("iResolution", glm::vec2(displayW, displayH));
-            glm::vec4 adjMouse = mouse;
-            adjMouse.x -= displayX;
-            adjMouse.y -= displayY;
-            shaders[currentShaderIndex]->setUniform("iMouse", adjMouse);
-            shaders[currentShaderIndex]->setUniform("iMouseNormalized", glm::vec2(adjMouse.x / displayW, 1.0f - adjMouse.y / displayH));
-            
-            shaders[currentShaderIndex]->setUniform("iMouseActive", iMouseClick);
-            shaders[currentShaderIndex]->setUniform("iMouseVelocity", iMouseVelocity);
-            shaders[currentShaderIndex]->setUniform("iMouseClick", iMouseClick);
-            shaders[currentShaderIndex]->setUniform("iAspectRatio", static_cast<float>(displayW) / static_cast<float>(displayH));
-            shaders[currentShaderIndex]->setUniform("iSpeed", iSpeed);
-            shaders[currentShaderIndex]->setUniform("iFrequency", iFrequency);
-            shaders[currentShaderIndex]->setUniform("iAmplitude", iAmplitude);
-            shaders[currentShaderIndex]->setUniform("iHueShift", iHueShift);
-            shaders[currentShaderIndex]->setUniform("iSaturation", iSaturation);
-            shaders[currentShaderIndex]->setUniform("iBrightness", iBrightness);
-            shaders[currentShaderIndex]->setUniform("iContrast", iContrast);
-            shaders[currentShaderIndex]->setUniform("iZoom", iZoom);
-            shaders[currentShaderIndex]->setUniform("iRotation", iRotation);
-            shaders[currentShaderIndex]->setUniform("iCameraPos", iCameraPos);
-            shaders[currentShaderIndex]->setUniform("iBeat", beatValue);
-            shaders[currentShaderIndex]->setUniform("iAudioLevel", audioLevel);
-            shaders[currentShaderIndex]->setUniform("iDebugMode", iDebugMode);
-            shaders[currentShaderIndex]->setUniform("iQuality", iQuality);
-            
-            shaders[currentShaderIndex]->setUniform("alpha", 1.0f);
-            shaders[currentShaderIndex]->setUniform("amp", 0.5f);
-            shaders[currentShaderIndex]->setUniform("uamp", 0.5f);
-            shaders[currentShaderIndex]->setUniform("textTexture", 0);
-        }  else {
-            shaders2[currentShaderIndex]->useProgram();
-            shaders2[currentShaderIndex]->setUniform("time_f", animation);
-            shaders2[currentShaderIndex]->setUniform("iTime", animation);
-            shaders2[currentShaderIndex]->setUniform("iTimeDelta", deltaTime);
-            shaders2[currentShaderIndex]->setUniform("iFrame", static_cast<float>(frameCount));
-            shaders2[currentShaderIndex]->setUniform("iSeconds", iSeconds);
-            shaders2[currentShaderIndex]->setUniform("iMinutes", iMinutes);
-            shaders2[currentShaderIndex]->setUniform("iHours", iHours);
-            shaders2[currentShaderIndex]->setUniform("iResolution", glm::vec2(displayW, displayH));
-            glm::vec4 adjMouse = mouse;
-            adjMouse.x -= displayX;
-            adjMouse.y -= displayY;
-            shaders2[currentShaderIndex]->setUniform("iMouse", adjMouse);
-            shaders2[currentShaderIndex]->setUniform("iMouseNormalized", glm::vec2(adjMouse.x / displayW, 1.0f - adjMouse.y / displayH));
-            shaders2[currentShaderIndex]->setUniform("iMouseActive", iMouseClick);
-            shaders2[currentShaderIndex]->setUniform("iMouseVelocity", iMouseVelocity);
-            shaders2[currentShaderIndex]->setUniform("iMouseClick", iMouseClick);
-            shaders2[currentShaderIndex]->setUniform("iAspectRatio", static_cast<float>(displayW) / static_cast<float>(displayH));
-            shaders2[currentShaderIndex]->setUniform("iSpeed", iSpeed);
-            shaders2[currentShaderIndex]->setUniform("iFrequency", iFrequency);
-            shaders2[currentShaderIndex]->setUniform("iAmplitude", iAmplitude);
-            shaders2[currentShaderIndex]->setUniform("iHueShift", iHueShift);
-            shaders2[currentShaderIndex]->setUniform("iSaturation", iSaturation);
-            shaders2[currentShaderIndex]->setUniform("iBrightness", iBrightness);
-            shaders2[currentShaderIndex]->setUniform("iContrast", iContrast);
-            shaders2[currentShaderIndex]->setUniform("iZoom", iZoom);
-            shaders2[currentShaderIndex]->setUniform("iRotation", iRotation);
-            shaders2[currentShaderIndex]->setUniform("iCameraPos", iCameraPos);
-            shaders2[currentShaderIndex]->setUniform("iBeat", beatValue);
-            shaders2[currentShaderIndex]->setUniform("iAudioLevel", audioLevel);
-            shaders2[currentShaderIndex]->setUniform("iDebugMode", iDebugMode);
-            shaders2[currentShaderIndex]->setUniform("iQuality", iQuality);
-            shaders2[currentShaderIndex]->setUniform("alpha", 1.0f);
-            shaders2[currentShaderIndex]->setUniform("amp", 0.5f);
-            shaders2[currentShaderIndex]->setUniform("uamp", 0.5f);
-            shaders2[currentShaderIndex]->setUniform("textTexture", 0);
+        if(scaler.isEnabled() || governor.isEnabled()) {
+            double ms = 0.0;
+            if(gpuClock.isAvailable()) {
+                GpuFrameClock::Sample sample;
+                while((sample = gpuClock.poll(ms)) != GpuFrameClock::Sample::Pending) {
+                    if(sample == GpuFrameClock::Sample::Ready) addFrameCost(ms);
+                }
+            } else if(cpuRenderMs > 0.0) {
+                // Without timer queries, the CPU time spent drawing the
+                // last frame; deltaTime would include vsync and pacing.
+                addFrameCost(cpuRenderMs);
+            }
+        }
+        if(renderScale != scaler.getScale()) {
+            renderScale = scaler.getScale();
+            targetPool.trim();
         }
+        gl::ShaderProgram *program = is3d ? program3D() : shaders2[currentShaderIndex].get();
+        program->useProgram();
+        setFrameUniforms(program, deltaTime);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -985,13 +1877,22 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         update(deltaTime);
-        sprite.initSize(canvasWidth, canvasHeight);
-        if(is3d)
-            drawModel(win);
-        else
-            drawModel2D(win);
+        quads.setSurface(canvasWidth, canvasHeight);
+        if(scaler.isEnabled() || governor.isEnabled()) gpuClock.begin();
+        auto renderStart = std::chrono::steady_clock::now();
+        if(browsing)
+            drawThumbnails(deltaTime);
+        else if(!useLoopCache() || !drawLooped(deltaTime))
+            drawLive(win, deltaTime);
+        cpuRenderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+        gpuClock.end();
+
+        drawnInputs = frameInputs();
+        redrawRequested = false;
 
         if (captureNextFrame) {
+            FRAME_PHASE(FramePhase::Capture);
+            TRACE_SCOPE("render", "captureFrame");
             captureNextFrame = false;
             captureFrame();
         }
@@ -1013,7 +1914,10 @@ public:
     void setHueShift(float value) { iHueShift = value; }
     void setZoom(float value) { iZoom = value; }
     void setRotation(float value) { iRotation = value; }
-    void setQuality(float value) { iQuality = value; }
+    void setQuality(float value) {
+        governor.setCeiling(value);
+        iQuality = governor.isEnabled() ? governor.getQuality() : value;
+    }
     void setDebugMode(bool value) { iDebugMode = value ? 1.0f : 0.0f; }
     
     float getSpeed() const { return iSpeed; }
@@ -1054,6 +1958,7 @@ public:
         canvasHeight = win->h;
         
         glViewport(0, 0, canvasWidth, canvasHeight);
+        targetPool.trim();
         forceTextureRebind();
         
         if (texWidth > 0 && texHeight > 0) {
@@ -1075,7 +1980,7 @@ public:
             printf("resize: canvas=%dx%d, display=(%d,%d) %dx%d\n",
                    canvasWidth, canvasHeight, displayX, displayY, displayW, displayH);
             
-            sprite.initSize(canvasWidth, canvasHeight);
+            quads.setSurface(canvasWidth, canvasHeight);
             switchShader(currentShaderIndex, win);
             forceTextureRebind();
         }
@@ -1124,6 +2029,11 @@ public:
                     mouse.y = static_cast<float>(win->h - e.button.y);
                     mouse.z = 1.0f;  
                     mouse.w = 1.0f;  
+                    int picked = thumbnailAt(mouse.x, mouse.y);
+                    if(picked >= 0) {
+                        browsing = false;
+                        switchShader(picked, win);
+                    }
                 }
                 break;
             case SDL_MOUSEBUTTONUP:
@@ -1147,6 +2057,9 @@ public:
             else if(e.key.keysym.sym == SDLK_UP || e.key.keysym.sym == SDLK_BACKSPACE) {
                 prevShader(win);
             }
+            else if(e.key.keysym.sym == SDLK_TAB) {
+                setShaderBrowser(!browsing);
+            }
             break;
         }
     }
@@ -1161,7 +2074,8 @@ public:
     }
 
 
-    std::string compileCustomShader(const std::string &fragmentSource, gl::GLWindow *win) {
+    std::string compileCustomShader(const std::string &source, gl::GLWindow *win) {
+        std::string fragmentSource = expandShaderIncludes(source);
         auto customShader1 = std::make_unique<gl::ShaderProgram>();
         auto customShader2 = std::make_unique<gl::ShaderProgram>();
         if(!customShader1->loadProgramFromText(sz3DVertex, fragmentSource.c_str())) {
@@ -1175,13 +2089,21 @@ public:
         customShader2->setSilent(true);
         static bool hasCustomShader = false;
         if(hasCustomShader && !shaders.empty() && !shaders2.empty()) {
+            uniformUse.back() = reflectUniformUse(customShader2->id());
             shaders.back() = std::move(customShader1);
             shaders2.back() = std::move(customShader2);
+            fragmentSources.back() = fragmentSource;
+            for(auto &programs : shaderVariants) {
+                if(programs.size() == shaders.size()) programs.back().reset();
+            }
         } else {
+            uniformUse.push_back(reflectUniformUse(customShader2->id()));
             shaders.push_back(std::move(customShader1));
             shaders2.push_back(std::move(customShader2));
+            fragmentSources.push_back(fragmentSource);
             hasCustomShader = true;
         }   
+        opacity.clear();
         currentShaderIndex = shaders.size() - 1;
         switchShader(currentShaderIndex, win);
         return "SUCCESS: Shader compiled and applied successfully!";
@@ -1323,6 +2245,16 @@ public:
                 console.error('Save error:', e);
             }
         }, cropW, cropH, croppedPixels.data(), finalW, finalH);
+#else
+        SDL_Surface *out = SDL_CreateRGBSurfaceWithFormatFrom(croppedPixels.data(), cropW, cropH, 32, cropW * 4, SDL_PIXELFORMAT_RGBA32);
+        if(!out) {
+            mx::system_err << "Failed to create capture surface: " << SDL_GetError() << "\n";
+            return;
+        }
+        if(IMG_SavePNG(out, capturePath.c_str()) != 0) {
+            mx::system_err << "Failed to save " << capturePath << ": " << IMG_GetError() << "\n";
+        }
+        SDL_FreeSurface(out);
 #endif
         printf("Frame captured and saved\n");
     }
@@ -1330,9 +2262,11 @@ public:
 
 class MainWindow : public gl::GLWindow {
 public:
-    MainWindow(std::string path, int tw, int th) : gl::GLWindow("ACMX2 - Interactive Visualizer", tw, th) {
+    MainWindow(std::string path, int tw, int th, const std::string &image = "data/logo.png") : gl::GLWindow("ACMX2 - Interactive Visualizer", tw, th) {
         setPath(path);
-        setObject(new About());
+        About *about = new About();
+        about->setStartupImage(image);
+        setObject(about);
         object->load(this);
     }
     
@@ -1343,14 +2277,38 @@ public:
     }
     
     virtual void draw() override {
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
+        About *about = static_cast<About *>(object.get());
+        pacer.apply();
+        if(!about->needsRedraw()) {
+            about->skipFrame();
+            pacer.frameSkipped();
+            pacer.idle();
+            return;
+        }
+        {
+            FRAME_PHASE(FramePhase::Frame);
+            TRACE_SCOPE("frame", "frame");
+            renderFrame();
+            FRAME_PHASE(FramePhase::Present);
+            TRACE_SCOPE("frame", "present");
+            swap();
+        }
+        // Outside the phase and trace scopes, so a fixed rate's sleep is
+        // not counted as present or frame time.
+        pacer.frameDelivered();
+        pacer.wait();
+        FRAME_STATS_END_FRAME();
+    }
+
+    void renderFrame() {
+        About *about = static_cast<About *>(object.get());
         glViewport(0, 0, w, h);
+        about->beginFrame();
         object->draw(this);
-        swap();
-        delay();
+        about->endFrame();
     }
+
+    FramePacer pacer;
 };
 
 MainWindow *main_w = nullptr;
@@ -1372,7 +2330,7 @@ About *about_ptr = nullptr;
 
     void loadModel(const std::string &info) {
         if(about_ptr) {
-            about_ptr->loadModelFile("data/compressed/"+info);
+            about_ptr->requestModelFile("data/compressed/"+info);
         }
     }
 
@@ -1708,6 +2666,140 @@ About *about_ptr = nullptr;
         return 0;
     }
 
+    std::string getFrameStats() {
+        return FRAME_STATS_JSON();
+    }
+
+    bool addEffectPass(int index) {
+        if(about_ptr) return about_ptr->addChainPass(index);
+        return false;
+    }
+
+    void clearEffectChain() {
+        if(about_ptr) about_ptr->clearChain();
+    }
+
+    int getEffectChainLength() {
+        if(about_ptr) return about_ptr->getChainLength();
+        return 0;
+    }
+
+    void setDynamicResolution(bool value) {
+        if(about_ptr) about_ptr->setDynamicResolution(value);
+    }
+
+    void setTargetFrameTime(float ms) {
+        if(about_ptr) about_ptr->setTargetFrameTime(ms);
+    }
+
+    void setResolutionScaleRange(float minScale, float maxScale) {
+        if(about_ptr) about_ptr->setResolutionScaleRange(minScale, maxScale);
+    }
+
+    float getRenderScale() {
+        if(about_ptr) return about_ptr->getRenderScale();
+        return 1.0f;
+    }
+
+    void setQualityGovernor(bool value) {
+        if(about_ptr) about_ptr->setQualityGovernor(value);
+    }
+
+    void setFeedbackEnabled(bool value) {
+        if(about_ptr) about_ptr->setFeedback(value);
+    }
+
+    void setIdleSkipping(bool value) {
+        if(about_ptr) about_ptr->setIdleSkipping(value);
+    }
+
+    void setShaderBrowser(bool value) {
+        if(about_ptr) about_ptr->setShaderBrowser(value);
+    }
+
+    void setThumbnailBudget(float ms) {
+        if(about_ptr) about_ptr->setThumbnailBudget(ms);
+    }
+
+    bool setFramePacing(std::string value) {
+        PacingMode mode;
+        double fps = 60.0;
+        if(!main_w || !parsePacing(value, mode, fps)) return false;
+        main_w->pacer.setMode(mode, fps);
+        return true;
+    }
+
+    bool setLoopCache(bool enabled, float period, float fps) {
+        if(about_ptr) return about_ptr->setLoopCache(enabled, period, fps);
+        return false;
+    }
+
+    void setLoopCacheLimits(float scale, int megabytes) {
+        if(about_ptr) about_ptr->setLoopCacheLimits(scale, megabytes);
+    }
+
+    std::string getLoopCacheStatus() {
+        if(about_ptr) return about_ptr->getLoopCacheStatus();
+        return "{}";
+    }
+
+    void setModelCacheBudget(int megabytes) {
+        if(about_ptr && megabytes > 0) about_ptr->setModelCacheBudget(static_cast<size_t>(megabytes) << 20);
+    }
+
+    std::string getModelCacheStats() {
+        if(about_ptr) return about_ptr->getModelCacheStats();
+        return "{}";
+    }
+
+    void setLodThreshold(float pixels) {
+        if(about_ptr) about_ptr->setLodThreshold(pixels);
+    }
+
+    std::string getModelLodStats() {
+        if(about_ptr) return about_ptr->getModelLodStats();
+        return "{}";
+    }
+
+    void setModelQuantization(bool value) {
+        if(about_ptr) about_ptr->setModelQuantization(value);
+    }
+
+    void setModelInstances(int count, float timeSpread) {
+        if(about_ptr) about_ptr->setModelInstances(static_cast<size_t>(std::max(0, count)), timeSpread);
+    }
+
+    std::string getPacingStats() {
+        if(main_w) return main_w->pacer.toJSON();
+        return "{}";
+    }
+
+    std::string getQualitySettings() {
+        if(about_ptr) return about_ptr->getQualitySettings();
+        return "";
+    }
+
+    void setQualitySettings(std::string text) {
+        if(about_ptr) about_ptr->setQualitySettings(text);
+    }
+
+    void setTraceEnabled(bool value) {
+        TraceRecorder::instance().setEnabled(value);
+    }
+
+    void clearTrace() {
+        TraceRecorder::instance().clear();
+    }
+
+    std::string getTrace() {
+        return TraceRecorder::instance().toJSON();
+    }
+
+    std::string getShaderProfile(const std::string &format) {
+        if(format == "csv") return ShaderProfiler::instance().toCSV();
+        return ShaderProfiler::instance().toJSON();
+    }
+
     void touchRotateX(float delta) {
         if(about_ptr) about_ptr->adjustCameraPitch(delta);
     }
@@ -1771,6 +2863,36 @@ About *about_ptr = nullptr;
         emscripten::function("setShaderIndex", &setShaderIndex);
         emscripten::function("getShaderCount", &getShaderCount);
         emscripten::function("getShaderNameAt", &getShaderNameAt);
+        emscripten::function("getFrameStats", &getFrameStats);
+        emscripten::function("getShaderProfile", &getShaderProfile);
+        emscripten::function("setTraceEnabled", &setTraceEnabled);
+        emscripten::function("addEffectPass", &addEffectPass);
+        emscripten::function("clearEffectChain", &clearEffectChain);
+        emscripten::function("getEffectChainLength", &getEffectChainLength);
+        emscripten::function("setDynamicResolution", &setDynamicResolution);
+        emscripten::function("setTargetFrameTime", &setTargetFrameTime);
+        emscripten::function("setResolutionScaleRange", &setResolutionScaleRange);
+        emscripten::function("getRenderScale", &getRenderScale);
+        emscripten::function("setQualityGovernor", &setQualityGovernor);
+        emscripten::function("setFeedbackEnabled", &setFeedbackEnabled);
+        emscripten::function("setIdleSkipping", &setIdleSkipping);
+        emscripten::function("setShaderBrowser", &setShaderBrowser);
+        emscripten::function("setThumbnailBudget", &setThumbnailBudget);
+        emscripten::function("setFramePacing", &setFramePacing);
+        emscripten::function("getPacingStats", &getPacingStats);
+        emscripten::function("setModelCacheBudget", &setModelCacheBudget);
+        emscripten::function("getModelCacheStats", &getModelCacheStats);
+        emscripten::function("setLodThreshold", &setLodThreshold);
+        emscripten::function("getModelLodStats", &getModelLodStats);
+        emscripten::function("setModelQuantization", &setModelQuantization);
+        emscripten::function("setModelInstances", &setModelInstances);
+        emscripten::function("setLoopCache", &setLoopCache);
+        emscripten::function("setLoopCacheLimits", &setLoopCacheLimits);
+        emscripten::function("getLoopCacheStatus", &getLoopCacheStatus);
+        emscripten::function("getQualitySettings", &getQualitySettings);
+        emscripten::function("setQualitySettings", &setQualitySettings);
+        emscripten::function("clearTrace", &clearTrace);
+        emscripten::function("getTrace", &getTrace);
     };
 
 #endif
@@ -1779,8 +2901,274 @@ void eventProc() {
     main_w->proc();
 }
 
+#ifndef __EMSCRIPTEN__
+
+static const int BENCH_WARMUP_FRAMES = 2;
+
+struct BenchOptions {
+    std::string report;
+    std::string model = "uv_sphere.mxmod.z";
+    int frames = 30;
+    std::vector<std::pair<int, int>> sizes = { {1280, 720}, {1920, 1080}, {3840, 2160} };
+};
+
+bool parseResolution(const std::string &text, int &width, int &height) {
+    auto pos = text.find("x");
+    if(pos == std::string::npos) return false;
+    width = atoi(text.substr(0, pos).c_str());
+    height = atoi(text.substr(pos+1).c_str());
+    return width > 0 && height > 0;
+}
+
+int runBenchmark(MainWindow &win, About *about, const BenchOptions &opt) {
+    // Always measure at full resolution and fixed quality; the controllers'
+    // timer queries would also nest inside the benchmark's own.
+    about->setDynamicResolution(false);
+    about->setQualityGovernor(false);
+    FrameTimer timer;
+    timer.init(opt.frames);
+    std::vector<BenchResult> results;
+    int savedW = win.w, savedH = win.h;
+    mx::system_out << "acmx2: benchmarking " << about->getShaderCount() << " shaders, " << opt.frames << " frames each, timing=" << timer.modeName() << "\n";
+    for(const auto &size : opt.sizes) {
+        RenderTarget target;
+        if(!target.create(size.first, size.second, true)) {
+            mx::system_err << "acmx2: skipping " << size.first << "x" << size.second << "\n";
+            continue;
+        }
+        win.w = size.first;
+        win.h = size.second;
+        about->resize(&win);
+        for(int mode = 0; mode < 2; ++mode) {
+            bool model3d = (mode == 1);
+            about->loadModelFile(win.util.getFilePath(model3d ? "data/compressed/" + opt.model : "data/compressed/quad.mxmod.z"));
+            for(int i = 0; i < about->getShaderCount(); ++i) {
+                about->switchShader(i, &win);
+                target.bind();
+                // Each frame is closed for the phase stats as in draw(), so
+                // --stats covers the whole run instead of filling the ring.
+                for(int f = 0; f < BENCH_WARMUP_FRAMES; ++f) {
+                    {
+                        FRAME_PHASE(FramePhase::Frame);
+                        win.renderFrame();
+                    }
+                    FRAME_STATS_END_FRAME();
+                }
+                timer.reset();
+                for(int f = 0; f < opt.frames; ++f) {
+                    timer.begin();
+                    {
+                        FRAME_PHASE(FramePhase::Frame);
+                        win.renderFrame();
+                    }
+                    timer.end();
+                    FRAME_STATS_END_FRAME();
+                }
+                BenchResult r;
+                r.shader = about->getShaderNameAt(i);
+                r.index = i;
+                r.mode = model3d ? "3d" : "2d";
+                r.width = size.first;
+                r.height = size.second;
+                r.stats = computeFrameStats(timer.collect());
+                mx::system_out << "acmx2: " << r.width << "x" << r.height << " " << r.mode << " " << r.shader << " median=" << r.stats.median_ms << "ms p99=" << r.stats.p99_ms << "ms\n";
+                results.push_back(r);
+            }
+        }
+        RenderTarget::unbind();
+    }
+    win.w = savedW;
+    win.h = savedH;
+    about->loadModelFile(win.util.getFilePath("data/compressed/quad.mxmod.z"));
+    about->resize(&win);
+    std::ofstream out(opt.report);
+    if(!out.is_open()) {
+        mx::system_err << "acmx2: could not write " << opt.report << "\n";
+        return EXIT_FAILURE;
+    }
+    writeBenchReport(out, timer.modeName(), opt.frames, results);
+    mx::system_out << "acmx2: wrote " << results.size() << " results to " << opt.report << "\n";
+    return EXIT_SUCCESS;
+}
+
+std::vector<std::string> readModelList(const std::string &dir) {
+    std::vector<std::string> names;
+    std::ifstream list(dir + "/list.txt");
+    std::string line;
+    while(std::getline(list, line)) {
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if(line.size() > 8 && line.compare(line.size() - 8, 8, ".mxmod.z") == 0) names.push_back(line);
+    }
+    return names;
+}
+
+static size_t fileSize(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    return file.is_open() ? static_cast<size_t>(file.tellg()) : 0;
+}
+
+// Writes a .mxmb next to every model in dir/list.txt, skipping copies
+// listed in the asset manifest (they load their original's pack).
+int convertModels(const std::string &dir, bool compress) {
+    std::vector<std::string> names = readModelList(dir);
+    if(names.empty()) {
+        mx::system_err << "acmx2: no models listed in " << dir << "/list.txt\n";
+        return EXIT_FAILURE;
+    }
+    AssetStore assets;
+    assets.loadManifest(dir + "/../assets.txt");
+    int failed = 0;
+    for(const auto &name : names) {
+        if(assets.isAlias("compressed/" + name)) {
+            mx::system_out << "acmx2: " << name << " is a copy of " << assets.resolve("data/compressed/" + name).substr(5) << ", skipped\n";
+            continue;
+        }
+        std::string source = dir + "/" + name;
+        std::string target = meshPackPath(source);
+        ModelData data;
+        if(!loadMxmod(source, data)) {
+            mx::system_err << "acmx2: could not convert " << source << "\n";
+            failed++;
+            continue;
+        }
+        VertexCacheStats before = analyzeVertexCache(data);
+        optimizeModel(data);
+        VertexCacheStats after = analyzeVertexCache(data);
+        buildModelLods(data);
+        std::string lods;
+        for(const auto &mesh : data.meshes) {
+            for(const auto &lod : mesh.lods) lods += " " + std::to_string(lod.indices.size() / 3);
+        }
+        if(!writeMeshPack(target, data, compress, meshPackSourceHash(source))) {
+            mx::system_err << "acmx2: could not write " << target << "\n";
+            failed++;
+            continue;
+        }
+        mx::system_out << "acmx2: " << name << " -> " << target << " (" << data.meshes.size() << " meshes, "
+                       << fileSize(source) << " -> " << fileSize(target) << " bytes, vertices "
+                       << before.vertices << " -> " << after.vertices << ", ACMR " << before.acmr << " -> " << after.acmr
+                       << ", " << after.triangles << " triangles, LODs" << (lods.empty() ? " none" : lods) << ")\n";
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Writes dataDir/assets.txt: each listed model and effect whose bytes
+// match an earlier one, with the file it copies. Makefile.em leaves the
+// copies out of the bundle.
+int writeAssetManifest(const std::string &dataDir) {
+    std::vector<std::string> names;
+    for(const auto &name : readModelList(dataDir + "/compressed")) names.push_back("compressed/" + name);
+    std::ifstream index(dataDir + "/shaders/index.txt");
+    std::string line;
+    while(std::getline(index, line)) {
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if(!line.empty()) names.push_back("shaders/" + line);
+    }
+    auto copies = findDuplicateAssets(dataDir, names);
+    std::ofstream out(dataDir + "/assets.txt");
+    if(!out.is_open()) {
+        mx::system_err << "acmx2: could not write " << dataDir << "/assets.txt\n";
+        return EXIT_FAILURE;
+    }
+    size_t saved = 0;
+    for(const auto &copy : copies) {
+        out << copy.first << " " << copy.second << "\n";
+        saved += fileSize(dataDir + "/" + copy.first);
+        mx::system_out << "acmx2: " << copy.first << " = " << copy.second << "\n";
+    }
+    mx::system_out << "acmx2: " << names.size() << " assets, " << copies.size() << " copies, "
+                   << saved << " bytes left out of the bundle\n";
+    return EXIT_SUCCESS;
+}
+
+// Times loading and uploading every listed model three ways: libmx2's
+// mx::Model on the .mxmod.z, the same file through loadMxmod, and the
+// .mxmb (converted first where missing). Each time is the best of a few
+// runs and includes a glFinish so the upload is counted. ACMR (16-entry
+// FIFO cache) is given for the authored order and for the pack.
+int runModelBenchmark(const std::string &dir, const std::string &report) {
+    static const int RUNS = 3;
+    std::vector<std::string> names = readModelList(dir);
+    auto best = [](auto &&load) {
+        double fastest = 0.0;
+        for(int run = 0; run < RUNS; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            if(!load()) return -1.0;
+            glFinish();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if(run == 0 || ms < fastest) fastest = ms;
+        }
+        return fastest;
+    };
+    std::ofstream out(report);
+    if(!out.is_open()) {
+        mx::system_err << "acmx2: could not write " << report << "\n";
+        return EXIT_FAILURE;
+    }
+    out << "{\n  \"renderer\": \"" << jsonEscape(glString(GL_RENDERER)) << "\",\n  \"models\": [\n";
+    double totalOld = 0.0, totalPack = 0.0;
+    for(size_t i = 0; i < names.size(); ++i) {
+        std::string source = dir + "/" + names[i];
+        std::string pack = meshPackPath(source);
+        MeshPackFile current;
+        if(!openMeshPackFor(source, current)) {
+            ModelData data;
+            if(!importMxmod(source, data) || !writeMeshPack(pack, data, false, meshPackSourceHash(source))) {
+                mx::system_err << "acmx2: could not convert " << source << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        double mxmodMs = best([&]() { mx::Model m; return m.openModel(source); });
+        double textMs = best([&]() {
+            ModelData data;
+            GpuModel gpu;
+            return loadMxmod(source, data) && gpu.upload(data);
+        });
+        double packMs = best([&]() {
+            MeshPackFile file;
+            GpuModel gpu;
+            return file.open(pack) && gpu.upload(file);
+        });
+        ModelData authored, packed;
+        loadMxmod(source, authored);
+        loadMeshPack(pack, packed);
+        VertexCacheStats before = analyzeVertexCache(authored), after = analyzeVertexCache(packed);
+        totalOld += std::max(0.0, mxmodMs);
+        totalPack += std::max(0.0, packMs);
+        char buf[384];
+        snprintf(buf, sizeof(buf), "\"mxmod_bytes\": %zu, \"mxmb_bytes\": %zu, \"mxmod_ms\": %.3f, \"text_ms\": %.3f, \"mxmb_ms\": %.3f, "
+                 "\"triangles\": %zu, \"vertices\": %zu, \"mxmb_vertices\": %zu, \"acmr\": %.3f, \"mxmb_acmr\": %.3f",
+                 fileSize(source), fileSize(pack), mxmodMs, textMs, packMs, before.triangles, before.vertices, after.vertices, before.acmr, after.acmr);
+        out << "    {\"model\": \"" << jsonEscape(names[i]) << "\", " << buf << "}" << (i + 1 < names.size() ? "," : "") << "\n";
+        mx::system_out << "acmx2: " << names[i] << " mxmod=" << mxmodMs << "ms text=" << textMs << "ms mxmb=" << packMs << "ms ACMR " << before.acmr << " -> " << after.acmr << "\n";
+    }
+    out << "  ]\n}\n";
+    mx::system_out << "acmx2: all models mxmod=" << totalOld << "ms mxmb=" << totalPack << "ms\n";
+    return EXIT_SUCCESS;
+}
+
+// Ids for options that only have a long form. Argz keys every option by a
+// character, and none of these is registered as a single-dash option.
+enum LongOption : char {
+    OPT_LOOP = '1',
+    OPT_CONVERT_MODELS = '2',
+    OPT_MODEL_BENCH = '3',
+    OPT_MODEL_CACHE = '4',
+    OPT_LOD = '5',
+    OPT_QUANTIZE_MODELS = '6',
+    OPT_INSTANCES = '7',
+    OPT_INSTANCE_TIME = '8',
+    OPT_DEDUPE_ASSETS = '9'
+};
+
+#endif
+
 int main(int argc, char **argv) {
 #ifdef __EMSCRIPTEN__
+#ifdef MX_SHADER_PROFILE
+    ShaderProfiler::instance().setDetailed(true);
+    ShaderProfiler::instance().setOutputPrefix("shader_profile");
+#endif
     try {
         MainWindow main_window("/", 1920, 1080);
         main_w =&main_window;
@@ -1790,6 +3178,402 @@ int main(int argc, char **argv) {
         std::cerr << e.text() << "\n";
         return EXIT_FAILURE;
     }  
+#else
+    Argz<std::string> parser(argc, argv);
+    parser.addOptionSingle('h', "Display help message")
+        .addOptionSingleValue('p', "assets path")
+        .addOptionDoubleValue('P', "path", "assets path")
+        .addOptionSingleValue('r', "Resolution WidthxHeight")
+        .addOptionDoubleValue('R', "resolution", "Resolution WidthxHeight")
+        .addOptionSingleValue('i', "input image")
+        .addOptionDoubleValue('I', "image", "input image")
+        .addOptionSingleValue('s', "shader index")
+        .addOptionDoubleValue('S', "shader", "shader index")
+        .addOptionSingleValue('m', "model file in data/compressed")
+        .addOptionDoubleValue('M', "model", "model file in data/compressed")
+        .addOptionSingleValue('n', "frames to render")
+        .addOptionDoubleValue('N', "frames", "frames to render")
+        .addOptionSingleValue('o', "save last frame as PNG")
+        .addOptionDoubleValue('O', "output", "save last frame as PNG")
+        .addOptionSingle('l', "list shaders")
+        .addOptionDouble('L', "list", "list shaders")
+        .addOptionSingle('w', "open a window instead of rendering headless")
+        .addOptionDouble('W', "window", "open a window instead of rendering headless")
+        .addOptionSingleValue('b', "benchmark every shader and write JSON report")
+        .addOptionDoubleValue('B', "bench", "benchmark every shader and write JSON report")
+        .addOptionSingleValue('k', "benchmark frames per shader")
+        .addOptionDoubleValue('K', "bench-frames", "benchmark frames per shader")
+        .addOptionSingleValue('z', "benchmark sizes, e.g. 1280x720,1920x1080")
+        .addOptionDoubleValue('Z', "bench-sizes", "benchmark sizes, e.g. 1280x720,1920x1080")
+        .addOptionSingleValue('t', "write frame phase stats JSON (- for stdout)")
+        .addOptionDoubleValue('T', "stats", "write frame phase stats JSON (- for stdout)")
+        .addOptionSingleValue('c', "profile shader compile/link, write PREFIX.csv and PREFIX.json")
+        .addOptionDoubleValue('C', "shader-profile", "profile shader compile/link, write PREFIX.csv and PREFIX.json")
+        .addOptionSingleValue('e', "record Chrome trace events to file")
+        .addOptionDoubleValue('E', "trace", "record Chrome trace events to file")
+        .addOptionSingleValue('a', "effects applied after the shader, e.g. VHS,12")
+        .addOptionDoubleValue('A', "chain", "effects applied after the shader, e.g. VHS,12")
+        .addOptionSingleValue('d', "scale render resolution to meet a frame time in ms")
+        .addOptionDoubleValue('D', "dynamic-res", "scale render resolution to meet a frame time in ms")
+        .addOptionSingleValue('g', "dynamic resolution scale range, e.g. 0.5,1.0")
+        .addOptionDoubleValue('G', "scale-range", "dynamic resolution scale range, e.g. 0.5,1.0")
+        .addOptionSingleValue('q', "adapt iQuality per effect, learned levels kept in file")
+        .addOptionDoubleValue('Q', "quality-governor", "adapt iQuality per effect, learned levels kept in file")
+        .addOptionSingle('f', "bind the previous frame as iPrevFrame")
+        .addOptionDouble('F', "feedback", "bind the previous frame as iPrevFrame")
+        .addOptionSingle('u', "skip redraw while a time-independent effect is unchanged")
+        .addOptionDouble('U', "idle-skip", "skip redraw while a time-independent effect is unchanged")
+        .addOptionSingleValue('j', "frame pacing: vsync, uncapped or a frame rate")
+        .addOptionDoubleValue('J', "pacing", "frame pacing: vsync, uncapped or a frame rate")
+        .addOptionSingle('y', "start in the shader browser (thumbnail grid)")
+        .addOptionDouble('Y', "browse", "start in the shader browser (thumbnail grid)")
+        .addOptionSingleValue('x', "cache static thumbnails in this PNG between runs")
+        .addOptionDoubleValue('X', "thumbnail-cache", "cache static thumbnails in this PNG between runs")
+        .addOptionDoubleValue(OPT_LOOP, "loop", "play back a cached loop: PERIOD[,FPS[,SCALE[,MB]]]")
+        .addOptionDoubleValue(OPT_CONVERT_MODELS, "convert-models", "write .mxmb for every model in data/compressed/list.txt: raw or deflate")
+        .addOptionDoubleValue(OPT_MODEL_BENCH, "model-bench", "time loading every model per format and write JSON report")
+        .addOptionDoubleValue(OPT_MODEL_CACHE, "model-cache", "megabytes of uploaded models kept for switching back (default 64)")
+        .addOptionDoubleValue(OPT_LOD, "lod", "largest level-of-detail error in pixels, 0 for full meshes (default 1)")
+        .addOptionDouble(OPT_QUANTIZE_MODELS, "quantize-models", "upload models with 16-bit positions, octahedral normals and half-float UVs")
+        .addOptionDoubleValue(OPT_INSTANCES, "instances", "draw this many copies of the model around the camera")
+        .addOptionDoubleValue(OPT_INSTANCE_TIME, "instance-time", "offset each copy's effect time by up to this many seconds")
+        .addOptionDouble(OPT_DEDUPE_ASSETS, "dedupe-assets", "list identical models and effects in data/assets.txt and exit");
+    Argument<std::string> arg;
+    std::string path = ".";
+    std::string image = "data/logo.png";
+    std::string model_file;
+    std::string output;
+    std::string stats_file;
+    std::string trace_file;
+    std::string chain_list;
+    double target_ms = 0.0;
+    std::string quality_file;
+    float min_scale = 0.5f, max_scale = 1.0f;
+    int value = 0;
+    int tw = 1920, th = 1080;
+    int shader_index = 0;
+    int frames = 60;
+    bool list = false;
+    bool windowed = false;
+    bool feedback = false;
+    bool idle_skip = false;
+    std::string pacing;
+    bool browse = false;
+    std::string thumbnail_cache;
+    double loop_period = 0.0, loop_fps = 30.0;
+    float loop_scale = 0.5f;
+    int loop_mb = 256;
+    std::string convert_models;
+    std::string model_bench;
+    int model_cache_mb = 0;
+    float lod_threshold = -1.0f;
+    bool quantize_models = false;
+    bool dedupe_assets = false;
+    int instance_count = 0;
+    float instance_time = 0.0f;
+    BenchOptions bench;
+    try {
+        while((value = parser.proc(arg)) != -1) {
+            switch(value) {
+                case 'h':
+                case 'v':
+                    parser.help(std::cout);
+                    exit(EXIT_SUCCESS);
+                    break;
+                case 'p':
+                case 'P':
+                    path = arg.arg_value;
+                    break;
+                case 'r':
+                case 'R':
+                    if(!parseResolution(arg.arg_value, tw, th))  {
+                        mx::system_err << "Error invalid resolution use WidthxHeight\n";
+                        mx::system_err.flush();
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case 'i':
+                case 'I':
+                    image = arg.arg_value;
+                    break;
+                case 's':
+                case 'S':
+                    shader_index = atoi(arg.arg_value.c_str());
+                    break;
+                case 'm':
+                case 'M':
+                    model_file = arg.arg_value;
+                    break;
+                case 'n':
+                case 'N':
+                    frames = atoi(arg.arg_value.c_str());
+                    break;
+                case 'o':
+                case 'O':
+                    output = arg.arg_value;
+                    break;
+                case 'l':
+                case 'L':
+                    list = true;
+                    break;
+                case 'w':
+                case 'W':
+                    windowed = true;
+                    break;
+                case 'c':
+                case 'C':
+                    ShaderProfiler::instance().setDetailed(true);
+                    ShaderProfiler::instance().setOutputPrefix(arg.arg_value);
+                    break;
+                case 'a':
+                case 'A':
+                    chain_list = arg.arg_value;
+                    break;
+                case 'd':
+                case 'D':
+                    target_ms = atof(arg.arg_value.c_str());
+                    break;
+                case 'f':
+                case 'F':
+                    feedback = true;
+                    break;
+                case 'u':
+                case 'U':
+                    idle_skip = true;
+                    break;
+                case 'j':
+                case 'J':
+                    pacing = arg.arg_value;
+                    break;
+                case 'y':
+                case 'Y':
+                    browse = true;
+                    break;
+                case 'x':
+                case 'X':
+                    thumbnail_cache = arg.arg_value;
+                    break;
+                case OPT_LOOP:
+                    if(sscanf(arg.arg_value.c_str(), "%lf,%lf,%f,%d", &loop_period, &loop_fps, &loop_scale, &loop_mb) < 1 || loop_period <= 0.0 || loop_fps <= 0.0) {
+                        mx::system_err << "Error invalid loop: " << arg.arg_value << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case OPT_CONVERT_MODELS:
+                    convert_models = arg.arg_value;
+                    if(convert_models != "raw" && convert_models != "deflate") {
+                        mx::system_err << "Error invalid model compression: " << convert_models << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case OPT_MODEL_BENCH:
+                    model_bench = arg.arg_value;
+                    break;
+                case OPT_MODEL_CACHE:
+                    model_cache_mb = atoi(arg.arg_value.c_str());
+                    if(model_cache_mb <= 0) {
+                        mx::system_err << "Error invalid model cache size: " << arg.arg_value << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case OPT_QUANTIZE_MODELS:
+                    quantize_models = true;
+                    break;
+                case OPT_LOD:
+                    lod_threshold = static_cast<float>(atof(arg.arg_value.c_str()));
+                    if(lod_threshold < 0.0f) {
+                        mx::system_err << "Error invalid LOD threshold: " << arg.arg_value << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case OPT_INSTANCES:
+                    instance_count = atoi(arg.arg_value.c_str());
+                    if(instance_count < 0) {
+                        mx::system_err << "Error invalid instance count: " << arg.arg_value << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case OPT_INSTANCE_TIME:
+                    instance_time = static_cast<float>(atof(arg.arg_value.c_str()));
+                    break;
+                case OPT_DEDUPE_ASSETS:
+                    dedupe_assets = true;
+                    break;
+                case 'q':
+                case 'Q':
+                    quality_file = arg.arg_value;
+                    break;
+                case 'g':
+                case 'G':
+                    if(sscanf(arg.arg_value.c_str(), "%f,%f", &min_scale, &max_scale) != 2 || min_scale <= 0.0f || min_scale > max_scale) {
+                        mx::system_err << "Error invalid scale range: " << arg.arg_value << "\n";
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case 'e':
+                case 'E':
+                    trace_file = arg.arg_value;
+                    TraceRecorder::instance().setEnabled(true);
+                    break;
+                case 't':
+                case 'T':
+                    stats_file = arg.arg_value;
+                    break;
+                case 'b':
+                case 'B':
+                    bench.report = arg.arg_value;
+                    break;
+                case 'k':
+                case 'K':
+                    bench.frames = std::max(1, atoi(arg.arg_value.c_str()));
+                    break;
+                case 'z':
+                case 'Z': {
+                    bench.sizes.clear();
+                    std::istringstream sizes(arg.arg_value);
+                    std::string item;
+                    while(std::getline(sizes, item, ',')) {
+                        int bw = 0, bh = 0;
+                        if(!parseResolution(item, bw, bh)) {
+                            mx::system_err << "Error invalid benchmark size: " << item << "\n";
+                            exit(EXIT_FAILURE);
+                        }
+                        bench.sizes.push_back({bw, bh});
+                    }
+                }
+                    break;
+            }
+        }
+    } catch (const ArgException<std::string>& e) {
+        mx::system_err << e.text() << "\n";
+        return EXIT_FAILURE;
+    }
+    if(dedupe_assets) {
+        return writeAssetManifest(path + "/data");
+    }
+    if(!convert_models.empty()) {
+        return convertModels(path + "/data/compressed", convert_models == "deflate");
+    }
+    if(!windowed) {
+        headless::useSurfacelessEGL();
+    }
+    try {
+        MainWindow main_window(path, tw, th, image);
+        main_w = &main_window;
+        about_ptr = dynamic_cast<About *>(main_w->object.get());
+        if(!about_ptr->isLoadingComplete()) {
+            mx::system_err << "acmx2: initialization failed\n";
+            return EXIT_FAILURE;
+        }
+        if(list) {
+            for(int i = 0; i < about_ptr->getShaderCount(); ++i) {
+                std::cout << i << ": " << about_ptr->getShaderNameAt(i) << "\n";
+            }
+            return EXIT_SUCCESS;
+        }
+        if(shader_index < 0 || shader_index >= about_ptr->getShaderCount()) {
+            mx::system_err << "acmx2: shader index out of range: " << shader_index << "\n";
+            return EXIT_FAILURE;
+        }
+        if(!model_bench.empty()) {
+            return runModelBenchmark(path + "/data/compressed", model_bench);
+        }
+        if(quantize_models) {
+            about_ptr->setModelQuantization(true);
+        }
+        if(instance_count > 0) {
+            about_ptr->setModelInstances(static_cast<size_t>(instance_count), instance_time);
+        }
+        if(!bench.report.empty()) {
+            if(!model_file.empty()) {
+                bench.model = model_file;
+            }
+            return runBenchmark(main_window, about_ptr, bench);
+        }
+        if(model_cache_mb > 0) {
+            about_ptr->setModelCacheBudget(static_cast<size_t>(model_cache_mb) << 20);
+        }
+        if(lod_threshold >= 0.0f) {
+            about_ptr->setLodThreshold(lod_threshold);
+        }
+        if(!model_file.empty()) {
+            about_ptr->loadModelFile(main_window.util.getFilePath("data/compressed/" + model_file));
+        }
+        about_ptr->switchShader(shader_index, &main_window);
+        if(!chain_list.empty()) {
+            std::istringstream passes(chain_list);
+            std::string item;
+            while(std::getline(passes, item, ',')) {
+                int index = about_ptr->findShader(item);
+                if(index < 0 && !item.empty() && std::all_of(item.begin(), item.end(), ::isdigit)) {
+                    index = atoi(item.c_str());
+                }
+                if(!about_ptr->addChainPass(index)) {
+                    mx::system_err << "acmx2: unknown effect in chain: " << item << "\n";
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        if(target_ms > 0.0) {
+            about_ptr->setResolutionScaleRange(min_scale, max_scale);
+            about_ptr->setTargetFrameTime(target_ms);
+            about_ptr->setDynamicResolution(true);
+        }
+        about_ptr->setFeedback(feedback);
+        about_ptr->setIdleSkipping(idle_skip);
+        PacingMode pacing_mode = windowed ? PacingMode::VSync : PacingMode::Uncapped;
+        double pacing_fps = 60.0;
+        if(!pacing.empty() && !parsePacing(pacing, pacing_mode, pacing_fps)) {
+            mx::system_err << "Error invalid pacing: " << pacing << "\n";
+            return EXIT_FAILURE;
+        }
+        main_window.pacer.setMode(pacing_mode, pacing_fps);
+        if(loop_period > 0.0) {
+            about_ptr->setLoopCacheLimits(loop_scale, loop_mb);
+            about_ptr->setLoopCache(true, loop_period, loop_fps);
+        }
+        about_ptr->setThumbnailCache(thumbnail_cache);
+        about_ptr->setShaderBrowser(browse);
+        if(!quality_file.empty()) {
+            about_ptr->loadQualitySettings(quality_file);
+            about_ptr->setQualityGovernor(true);
+        }
+        if(windowed) {
+            main_window.loop();
+        } else {
+            for(int i = 0; i < frames; ++i) {
+                if(i == frames - 1 && !output.empty()) {
+                    about_ptr->setCapturePath(output);
+                    about_ptr->saveImage(1);
+                }
+                main_window.draw();
+            }
+        }
+        if(!trace_file.empty()) {
+            std::ofstream out(trace_file);
+            TraceRecorder::instance().write(out);
+        }
+        if(!thumbnail_cache.empty()) {
+            about_ptr->saveThumbnailCache();
+        }
+        if(!pacing.empty()) {
+            mx::system_out << "acmx2: pacing " << main_window.pacer.toJSON() << "\n";
+        }
+        if(!quality_file.empty() && !about_ptr->saveQualitySettings(quality_file)) {
+            mx::system_err << "acmx2: could not write " << quality_file << "\n";
+        }
+        if(!stats_file.empty()) {
+            if(stats_file == "-") {
+                std::cout << FRAME_STATS_JSON() << "\n";
+            } else {
+                std::ofstream out(stats_file);
+                out << FRAME_STATS_JSON() << "\n";
+            }
+        }
+    } catch (mx::Exception &e) {
+        std::cerr << e.text() << "\n";
+        return EXIT_FAILURE;
+    }
 #endif
     return 0;
 }
\ No newline at end of file
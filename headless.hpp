@@ -0,0 +1,23 @@
+#ifndef __HEADLESS_HPP_
+#define __HEADLESS_HPP_
+
+#ifndef __EMSCRIPTEN__
+#include<SDL2/SDL.h>
+#include<cstdlib>
+
+// Native builds without a display (build farm, CI) run through SDL's
+// "offscreen" video driver, which creates its GL context on an EGL pbuffer
+// instead of an X11/Wayland window. Asking Mesa for the surfaceless EGL
+// platform lets that context come up on llvmpipe with no GPU or DRM node.
+namespace headless {
+
+    inline void useSurfacelessEGL() {
+        if(!std::getenv("EGL_PLATFORM")) {
+            setenv("EGL_PLATFORM", "surfaceless", 1);
+        }
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+    }
+}
+#endif
+
+#endif
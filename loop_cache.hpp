@@ -0,0 +1,134 @@
+#ifndef __LOOP_CACHE_HPP_
+#define __LOOP_CACHE_HPP_
+
+#include"gl.hpp"
+#include"render_target.hpp"
+#include<zlib.h>
+#include<cmath>
+#include<cstdint>
+#include<cstdio>
+#include<string>
+#include<vector>
+
+// One period of an effect, pre-rendered at a fixed rate and kept on the CPU
+// as zlib-compressed RGB frames. Alpha is dropped and frames are deflated
+// at the fastest level, so decoding one costs far less than a heavy effect.
+// Frames are added until the period is complete or the byte budget would
+// be exceeded, in which case the cache gives up rather than evict part of
+// the loop.
+class LoopCache {
+public:
+    bool begin(int w, int h, double periodSeconds, double fps, size_t budgetBytes, uint64_t cacheKey) {
+        clear();
+        if(w <= 0 || h <= 0 || periodSeconds <= 0.0 || fps <= 0.0) return false;
+        width = w;
+        height = h;
+        period = periodSeconds;
+        rate = fps;
+        budget = budgetBytes;
+        key = cacheKey;
+        total = std::max<size_t>(1, static_cast<size_t>(std::lround(period * rate)));
+        frames.reserve(total);
+        active = true;
+        return playback.create(w, h, false, GL_RGB8);
+    }
+
+    void clear() {
+        frames.clear();
+        frames.shrink_to_fit();
+        bytes = 0;
+        total = 0;
+        active = false;
+        failed = false;
+        uploaded = SIZE_MAX;
+        playback.release();
+    }
+
+    std::string toJSON() const {
+        char buf[192];
+        snprintf(buf, sizeof(buf), "{\"state\": \"%s\", \"frames\": %zu, \"built\": %zu, \"bytes\": %zu, \"width\": %d, \"height\": %d}",
+                 !active ? "off" : failed ? "failed" : isReady() ? "ready" : "building", total, frames.size(), bytes, width, height);
+        return buf;
+    }
+
+    bool isActive() const { return active; }
+    bool isBuilding() const { return active && !failed && frames.size() < total; }
+    bool isReady() const { return active && !failed && total > 0 && frames.size() == total; }
+    bool hasFailed() const { return failed; }
+    size_t getFrameCount() const { return total; }
+    size_t getBuiltCount() const { return frames.size(); }
+    size_t getBytes() const { return bytes; }
+    uint64_t getKey() const { return key; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    double getPeriod() const { return period; }
+    RenderTarget &getPlayback() { return playback; }
+
+    // Animation time of the next frame to build.
+    float nextTime() const { return static_cast<float>(frames.size() / rate); }
+
+    // Reads the frame just rendered into source and stores it.
+    bool capture(RenderTarget &source) {
+        if(!isBuilding()) return false;
+        rgba.resize(static_cast<size_t>(width) * height * 4);
+        glBindFramebuffer(GL_FRAMEBUFFER, source.getFramebuffer());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        size_t pixels = static_cast<size_t>(width) * height;
+        rgb.resize(pixels * 3);
+        for(size_t i = 0; i < pixels; ++i) {
+            rgb[i * 3 + 0] = rgba[i * 4 + 0];
+            rgb[i * 3 + 1] = rgba[i * 4 + 1];
+            rgb[i * 3 + 2] = rgba[i * 4 + 2];
+        }
+        uLongf size = compressBound(static_cast<uLong>(rgb.size()));
+        std::vector<unsigned char> packed(size);
+        if(compress2(packed.data(), &size, rgb.data(), static_cast<uLong>(rgb.size()), Z_BEST_SPEED) != Z_OK ||
+           bytes + size > budget) {
+            failed = true;
+            frames.clear();
+            frames.shrink_to_fit();
+            bytes = 0;
+            return false;
+        }
+        packed.resize(size);
+        packed.shrink_to_fit();
+        bytes += size;
+        frames.push_back(std::move(packed));
+        return true;
+    }
+
+    // Uploads the frame for animation time t into the playback target, if
+    // it is not the one already there.
+    bool present(float t) {
+        if(!isReady()) return false;
+        double phase = std::fmod(static_cast<double>(t), period);
+        if(phase < 0.0) phase += period;
+        size_t index = std::min(total - 1, static_cast<size_t>(phase * rate));
+        if(index == uploaded) return true;
+        size_t pixels = static_cast<size_t>(width) * height;
+        rgb.resize(pixels * 3);
+        uLongf size = static_cast<uLongf>(rgb.size());
+        if(uncompress(rgb.data(), &size, frames[index].data(), static_cast<uLong>(frames[index].size())) != Z_OK) {
+            return false;
+        }
+        glBindTexture(GL_TEXTURE_2D, playback.getTexture());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+        uploaded = index;
+        return true;
+    }
+
+private:
+    std::vector<std::vector<unsigned char>> frames;
+    std::vector<unsigned char> rgba, rgb;
+    RenderTarget playback;
+    int width = 0, height = 0;
+    double period = 0.0, rate = 30.0;
+    size_t budget = 0, bytes = 0, total = 0;
+    size_t uploaded = SIZE_MAX;
+    uint64_t key = 0;
+    bool active = false, failed = false;
+};
+
+#endif
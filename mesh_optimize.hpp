@@ -0,0 +1,284 @@
+#ifndef __MESH_OPTIMIZE_HPP_
+#define __MESH_OPTIMIZE_HPP_
+
+#include"model_data.hpp"
+#include<algorithm>
+#include<array>
+#include<cmath>
+#include<cstdint>
+#include<cstring>
+#include<unordered_map>
+#include<vector>
+
+// Import-time reordering of a mesh so the GPU runs the vertex shader less
+// often and shades fewer hidden pixels. None of it changes what is drawn:
+// identical vertices are merged, triangles are reordered for the
+// post-transform cache and then by cluster for overdraw, and vertices are
+// renumbered in the order they are first fetched.
+
+struct VertexCacheStats {
+    size_t triangles = 0;
+    size_t vertices = 0;
+    size_t misses = 0;
+    double acmr = 0.0;   // transformed vertices per triangle (0.5 is ideal, 3 is none)
+    double atvr = 0.0;   // transformed vertices per vertex (1 is ideal)
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries.
+inline VertexCacheStats analyzeVertexCache(const MeshData &mesh, size_t cacheSize = 16) {
+    VertexCacheStats stats;
+    stats.triangles = mesh.indices.size() / 3;
+    stats.vertices = mesh.vertexCount();
+    std::vector<size_t> stamp(stats.vertices, 0);
+    size_t time = cacheSize + 1;
+    for(uint32_t index : mesh.indices) {
+        if(time - stamp[index] > cacheSize) {
+            stamp[index] = time++;
+            stats.misses++;
+        }
+    }
+    if(stats.triangles > 0) stats.acmr = static_cast<double>(stats.misses) / stats.triangles;
+    if(stats.vertices > 0) stats.atvr = static_cast<double>(stats.misses) / stats.vertices;
+    return stats;
+}
+
+inline VertexCacheStats analyzeVertexCache(const ModelData &model, size_t cacheSize = 16) {
+    VertexCacheStats total;
+    for(const auto &mesh : model.meshes) {
+        VertexCacheStats s = analyzeVertexCache(mesh, cacheSize);
+        total.triangles += s.triangles;
+        total.vertices += s.vertices;
+        total.misses += s.misses;
+    }
+    if(total.triangles > 0) total.acmr = static_cast<double>(total.misses) / total.triangles;
+    if(total.vertices > 0) total.atvr = static_cast<double>(total.misses) / total.vertices;
+    return total;
+}
+
+// The text format repeats a vertex for every triangle that uses it, so
+// without this no vertex is ever reused. Vertices merge only when all
+// eight attributes match bit for bit.
+inline void deduplicateVertices(MeshData &mesh) {
+    using Key = std::array<uint32_t, MeshData::STRIDE>;
+    struct KeyHash {
+        size_t operator()(const Key &k) const {
+            uint64_t h = 14695981039346656037ull;
+            for(uint32_t v : k) h = (h ^ v) * 1099511628211ull;
+            return static_cast<size_t>(h);
+        }
+    };
+    size_t count = mesh.vertexCount();
+    std::unordered_map<Key, uint32_t, KeyHash> seen;
+    seen.reserve(count);
+    std::vector<uint32_t> remap(count);
+    std::vector<float> unique;
+    unique.reserve(mesh.vertices.size());
+    for(size_t i = 0; i < count; ++i) {
+        Key key;
+        std::memcpy(key.data(), &mesh.vertices[i * MeshData::STRIDE], sizeof(Key));
+        auto inserted = seen.emplace(key, static_cast<uint32_t>(unique.size() / MeshData::STRIDE));
+        if(inserted.second) unique.insert(unique.end(), &mesh.vertices[i * MeshData::STRIDE], &mesh.vertices[i * MeshData::STRIDE] + MeshData::STRIDE);
+        remap[i] = inserted.first->second;
+    }
+    for(auto &index : mesh.indices) index = remap[index];
+    mesh.vertices.swap(unique);
+}
+
+// Forsyth's linear-speed vertex cache optimisation: triangles are emitted
+// greedily by a score that favours vertices near the front of a simulated
+// LRU cache and vertices with few triangles left to draw.
+inline void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    static const int CACHE = 32;
+    size_t triCount = indices.size() / 3;
+    if(triCount == 0) return;
+    std::vector<uint32_t> remaining(vertexCount, 0), offsets(vertexCount + 1, 0), adjacency(triCount * 3);
+    for(size_t i = 0; i < triCount * 3; ++i) offsets[indices[i] + 1]++;
+    for(size_t v = 0; v < vertexCount; ++v) {
+        remaining[v] = offsets[v + 1];
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < triCount * 3; ++i) adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<int> cachePos(vertexCount, -1);
+    auto vertexScore = [&](uint32_t v) {
+        if(remaining[v] == 0) return -1.0f;
+        float score = 0.0f;
+        int pos = cachePos[v];
+        if(pos >= 0) score = pos < 3 ? 0.75f : std::pow(1.0f - static_cast<float>(pos - 3) / (CACHE - 3), 1.5f);
+        return score + 2.0f / std::sqrt(static_cast<float>(remaining[v]));
+    };
+    std::vector<float> vScore(vertexCount), tScore(triCount, 0.0f);
+    for(size_t v = 0; v < vertexCount; ++v) vScore[v] = vertexScore(static_cast<uint32_t>(v));
+    for(size_t t = 0; t < triCount; ++t) {
+        for(int k = 0; k < 3; ++k) tScore[t] += vScore[indices[t * 3 + k]];
+    }
+
+    std::vector<bool> emitted(triCount, false);
+    std::vector<uint32_t> cache, next, output;
+    output.reserve(triCount * 3);
+    size_t cursor = 0;
+    long best = -1;
+    for(size_t done = 0; done < triCount; ++done) {
+        // Nothing in the cache has triangles left: start the next island.
+        if(best < 0) {
+            while(emitted[cursor]) cursor++;
+            best = static_cast<long>(cursor);
+        }
+        uint32_t tri = static_cast<uint32_t>(best);
+        emitted[tri] = true;
+        const uint32_t *corner = &indices[tri * 3];
+        output.insert(output.end(), corner, corner + 3);
+
+        next.clear();
+        for(int k = 0; k < 3; ++k) {
+            if(std::find(next.begin(), next.end(), corner[k]) == next.end()) next.push_back(corner[k]);
+        }
+        for(uint32_t v : cache) {
+            if(v != corner[0] && v != corner[1] && v != corner[2]) next.push_back(v);
+        }
+        for(int k = 0; k < 3; ++k) {
+            uint32_t v = corner[k];
+            uint32_t *begin = &adjacency[offsets[v]];
+            uint32_t *end = begin + remaining[v];
+            *std::find(begin, end, tri) = *(end - 1);
+            remaining[v]--;
+        }
+        for(size_t i = CACHE; i < next.size(); ++i) {
+            cachePos[next[i]] = -1;
+            vScore[next[i]] = vertexScore(next[i]);
+        }
+        if(next.size() > CACHE) next.resize(CACHE);
+        for(size_t i = 0; i < next.size(); ++i) {
+            cachePos[next[i]] = static_cast<int>(i);
+            vScore[next[i]] = vertexScore(next[i]);
+        }
+        cache.swap(next);
+
+        best = -1;
+        float top = -1.0f;
+        for(uint32_t v : cache) {
+            for(uint32_t i = 0; i < remaining[v]; ++i) {
+                uint32_t t = adjacency[offsets[v] + i];
+                const uint32_t *c = &indices[t * 3];
+                tScore[t] = vScore[c[0]] + vScore[c[1]] + vScore[c[2]];
+                if(tScore[t] > top) {
+                    top = tScore[t];
+                    best = static_cast<long>(t);
+                }
+            }
+        }
+    }
+    indices.swap(output);
+}
+
+inline void optimizeVertexCache(MeshData &mesh) {
+    optimizeVertexCache(mesh.indices, mesh.vertexCount());
+}
+
+// Tipsify-style overdraw ordering on cache-optimised triangles. The
+// sequence is cut into clusters where the cache starts cold (a triangle
+// whose three vertices all miss), so moving whole clusters costs little
+// ACMR. Clusters that face away from the mesh centre are drawn first:
+// they are the likely occluders, and depth testing then rejects more of
+// what is behind them.
+inline void optimizeOverdraw(MeshData &mesh, size_t cacheSize = 16) {
+    size_t triCount = mesh.indices.size() / 3;
+    size_t vertexCount = mesh.vertexCount();
+    if(triCount < 2) return;
+    auto position = [&](uint32_t v) {
+        const float *p = &mesh.vertices[v * MeshData::STRIDE];
+        return std::array<float, 3>{ p[0], p[1], p[2] };
+    };
+    std::vector<size_t> starts;
+    std::vector<size_t> stamp(vertexCount, 0);
+    size_t time = cacheSize + 1;
+    for(size_t t = 0; t < triCount; ++t) {
+        int misses = 0;
+        for(int k = 0; k < 3; ++k) {
+            uint32_t v = mesh.indices[t * 3 + k];
+            if(time - stamp[v] > cacheSize) {
+                stamp[v] = time++;
+                misses++;
+            }
+        }
+        if(t == 0 || misses == 3) starts.push_back(t);
+    }
+    if(starts.size() < 2) return;
+    starts.push_back(triCount);
+
+    std::array<double, 3> centre = { 0.0, 0.0, 0.0 };
+    double totalArea = 0.0;
+    struct Cluster {
+        size_t begin, end;
+        double sortKey;
+    };
+    std::vector<Cluster> clusters;
+    std::vector<std::array<double, 7>> sums(starts.size() - 1, std::array<double, 7>{});
+    for(size_t c = 0; c + 1 < starts.size(); ++c) {
+        auto &s = sums[c];
+        for(size_t t = starts[c]; t < starts[c + 1]; ++t) {
+            auto a = position(mesh.indices[t * 3]), b = position(mesh.indices[t * 3 + 1]), d = position(mesh.indices[t * 3 + 2]);
+            double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            double e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double area = 0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for(int k = 0; k < 3; ++k) {
+                double mid = (a[k] + b[k] + d[k]) / 3.0;
+                s[k] += mid * area;
+                s[3 + k] += n[k];
+                centre[k] += mid * area;
+            }
+            s[6] += area;
+            totalArea += area;
+        }
+    }
+    if(totalArea <= 0.0) return;
+    for(int k = 0; k < 3; ++k) centre[k] /= totalArea;
+    for(size_t c = 0; c + 1 < starts.size(); ++c) {
+        const auto &s = sums[c];
+        double key = 0.0;
+        if(s[6] > 0.0) {
+            double length = std::sqrt(s[3] * s[3] + s[4] * s[4] + s[5] * s[5]);
+            if(length > 0.0) {
+                for(int k = 0; k < 3; ++k) key += (s[k] / s[6] - centre[k]) * s[3 + k] / length;
+            }
+        }
+        clusters.push_back({ starts[c], starts[c + 1], key });
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+    std::vector<uint32_t> output;
+    output.reserve(mesh.indices.size());
+    for(const auto &c : clusters) output.insert(output.end(), mesh.indices.begin() + c.begin * 3, mesh.indices.begin() + c.end * 3);
+    mesh.indices.swap(output);
+}
+
+// Renumbers vertices in the order the index buffer first uses them, so
+// fetches walk the vertex buffer forwards; unused vertices are dropped.
+inline void optimizeVertexFetch(MeshData &mesh) {
+    std::vector<uint32_t> remap(mesh.vertexCount(), UINT32_MAX);
+    std::vector<float> ordered;
+    ordered.reserve(mesh.vertices.size());
+    uint32_t next = 0;
+    for(auto &index : mesh.indices) {
+        if(remap[index] == UINT32_MAX) {
+            remap[index] = next++;
+            ordered.insert(ordered.end(), &mesh.vertices[index * MeshData::STRIDE], &mesh.vertices[index * MeshData::STRIDE] + MeshData::STRIDE);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(ordered);
+}
+
+inline void optimizeMesh(MeshData &mesh) {
+    deduplicateVertices(mesh);
+    optimizeVertexCache(mesh);
+    optimizeOverdraw(mesh);
+    optimizeVertexFetch(mesh);
+}
+
+inline void optimizeModel(ModelData &model) {
+    for(auto &mesh : model.meshes) optimizeMesh(mesh);
+}
+
+#endif
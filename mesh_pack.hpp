@@ -0,0 +1,340 @@
+#ifndef __MESH_PACK_HPP_
+#define __MESH_PACK_HPP_
+
+#include"model_data.hpp"
+#include"content_hash.hpp"
+#include<zlib.h>
+#include<algorithm>
+#include<atomic>
+#include<cstdint>
+#include<cstdio>
+#include<cstring>
+#include<fstream>
+#include<string>
+#include<vector>
+#ifndef __EMSCRIPTEN__
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+// Binary model container (.mxmb). A 24-byte header and one entry per mesh
+// are followed by the vertex and index blobs, each starting on a 16-byte
+// boundary, in exactly the layout MeshData uploads (little-endian). A
+// blob is either stored raw, so a mapped file can go straight to
+// glBufferData, or deflated on its own so meshes decode independently.
+// A mesh's levels of detail follow its base indices in the same blob.
+// The header keeps the hash of the .mxmod.z it was built from, so a pack
+// left behind by an edited model can be told apart.
+enum MeshPackCompression : uint32_t {
+    MESH_PACK_RAW = 0,
+    MESH_PACK_DEFLATE = 1
+};
+
+struct MeshPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t reserved;
+    uint64_t sourceHash;
+};
+
+struct MeshPackEntry {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureIndex;
+    uint32_t compression;
+    uint64_t vertexOffset;
+    uint64_t vertexSize;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+    uint32_t lodCount;
+    uint32_t lodIndexCount[MESH_MAX_LODS];
+    float lodError[MESH_MAX_LODS];
+    uint32_t reserved;
+};
+
+static constexpr uint32_t MESH_PACK_VERSION = 3;
+static constexpr size_t MESH_PACK_ALIGN = 16;
+// zlib cannot inflate more than about 1032 bytes per packed byte, and no
+// blob is allowed past 1 GB, so a bad entry cannot demand a huge buffer.
+static constexpr uint64_t MESH_PACK_MAX_RATIO = 1032;
+static constexpr uint64_t MESH_PACK_MAX_BLOB = uint64_t(1) << 30;
+
+// data/compressed/torus.mxmod.z -> data/compressed/torus.mxmb
+inline std::string meshPackPath(const std::string &modelPath) {
+    const std::string suffix = ".mxmod.z";
+    if(modelPath.size() > suffix.size() && modelPath.compare(modelPath.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        return modelPath.substr(0, modelPath.size() - suffix.size()) + ".mxmb";
+    }
+    return modelPath + ".mxmb";
+}
+
+// Hash of a model's source file, or 0 if it cannot be read.
+inline uint64_t meshPackSourceHash(const std::string &modelPath) {
+    std::string bytes;
+    return readFileBytes(modelPath, bytes) ? fnv1a(bytes) : 0;
+}
+
+inline bool indicesInRange(const uint32_t *indices, size_t count, uint32_t vertexCount) {
+    for(size_t i = 0; i < count; ++i) {
+        if(indices[i] >= vertexCount) return false;
+    }
+    return true;
+}
+
+inline bool writeMeshPack(const std::string &filename, const ModelData &model, bool compress, uint64_t sourceHash = 0) {
+    std::vector<MeshPackEntry> entries(model.meshes.size(), MeshPackEntry{});
+    std::vector<std::vector<unsigned char>> blobs;
+    uint64_t offset = sizeof(MeshPackHeader) + entries.size() * sizeof(MeshPackEntry);
+    auto addBlob = [&](const void *data, size_t size, uint64_t &blobOffset, uint64_t &blobSize) {
+        std::vector<unsigned char> blob(static_cast<const unsigned char *>(data), static_cast<const unsigned char *>(data) + size);
+        if(compress) {
+            uLongf packedSize = compressBound(static_cast<uLong>(size));
+            std::vector<unsigned char> packed(packedSize);
+            if(compress2(packed.data(), &packedSize, blob.data(), static_cast<uLong>(size), Z_BEST_COMPRESSION) != Z_OK) return false;
+            packed.resize(packedSize);
+            blob.swap(packed);
+        }
+        offset = (offset + MESH_PACK_ALIGN - 1) / MESH_PACK_ALIGN * MESH_PACK_ALIGN;
+        blobOffset = offset;
+        blobSize = blob.size();
+        offset += blob.size();
+        blobs.push_back(std::move(blob));
+        return true;
+    };
+    for(size_t i = 0; i < model.meshes.size(); ++i) {
+        const MeshData &mesh = model.meshes[i];
+        MeshPackEntry &e = entries[i];
+        e.vertexCount = static_cast<uint32_t>(mesh.vertexCount());
+        e.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        e.textureIndex = mesh.textureIndex;
+        e.compression = compress ? MESH_PACK_DEFLATE : MESH_PACK_RAW;
+        e.lodCount = static_cast<uint32_t>(std::min(mesh.lods.size(), MESH_MAX_LODS));
+        std::vector<uint32_t> indices(mesh.indices);
+        for(uint32_t l = 0; l < e.lodCount; ++l) {
+            e.lodIndexCount[l] = static_cast<uint32_t>(mesh.lods[l].indices.size());
+            e.lodError[l] = mesh.lods[l].error;
+            indices.insert(indices.end(), mesh.lods[l].indices.begin(), mesh.lods[l].indices.end());
+        }
+        if(!addBlob(mesh.vertices.data(), mesh.vertices.size() * sizeof(float), e.vertexOffset, e.vertexSize) ||
+           !addBlob(indices.data(), indices.size() * sizeof(uint32_t), e.indexOffset, e.indexSize)) {
+            return false;
+        }
+    }
+    // Written beside the pack and renamed over it, so a reader that has
+    // the old pack mapped keeps its pages and a failed write leaves no
+    // half-written pack. The counter keeps two threads writing the same
+    // pack from sharing a temporary file.
+    static std::atomic<unsigned> writes{0};
+    std::string temporary = filename + "." + std::to_string(writes.fetch_add(1)) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary);
+    if(!file.is_open()) return false;
+    MeshPackHeader header = { {'M', 'X', 'M', 'B'}, MESH_PACK_VERSION, static_cast<uint32_t>(entries.size()), 0, sourceHash };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(MeshPackEntry));
+    uint64_t written = sizeof(header) + entries.size() * sizeof(MeshPackEntry);
+    static const char zeros[MESH_PACK_ALIGN] = {};
+    for(const auto &blob : blobs) {
+        uint64_t aligned = (written + MESH_PACK_ALIGN - 1) / MESH_PACK_ALIGN * MESH_PACK_ALIGN;
+        file.write(zeros, aligned - written);
+        file.write(reinterpret_cast<const char *>(blob.data()), blob.size());
+        written = aligned + blob.size();
+    }
+    file.close();
+    if(!file.good() || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// indices holds indexCount base indices followed by each level of detail.
+struct MeshView {
+    const float *vertices = nullptr;
+    size_t vertexCount = 0;
+    const uint32_t *indices = nullptr;
+    size_t indexCount = 0;
+    size_t lodCount = 0;
+    uint32_t lodIndexCount[MESH_MAX_LODS] = {};
+    float lodError[MESH_MAX_LODS] = {};
+    uint32_t textureIndex = 0;
+
+    size_t totalIndexCount() const {
+        size_t total = indexCount;
+        for(size_t l = 0; l < lodCount; ++l) total += lodIndexCount[l];
+        return total;
+    }
+};
+
+// Read access to a .mxmb file. Natively the file is mapped, so a raw mesh
+// is handed to the GPU from the page cache without a copy; the browser
+// build reads it into memory. Deflated blobs are inflated into scratch
+// buffers that stay valid until the next call to mesh().
+class MeshPackFile {
+public:
+    MeshPackFile() = default;
+    ~MeshPackFile() { close(); }
+    MeshPackFile(const MeshPackFile &) = delete;
+    MeshPackFile &operator=(const MeshPackFile &) = delete;
+
+    bool open(const std::string &filename) {
+        close();
+#ifndef __EMSCRIPTEN__
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(MeshPackHeader))) {
+            ::close(fd);
+            return false;
+        }
+        void *mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapping == MAP_FAILED) return false;
+        mapped = mapping;
+        data = static_cast<const unsigned char *>(mapping);
+        size = static_cast<size_t>(info.st_size);
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if(!file.is_open()) return false;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+#endif
+        if(!validate()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifndef __EMSCRIPTEN__
+        if(mapped) munmap(mapped, size);
+        mapped = nullptr;
+#endif
+        buffer.clear();
+        buffer.shrink_to_fit();
+        data = nullptr;
+        size = 0;
+        count = 0;
+        source = 0;
+    }
+
+    bool isOpen() const { return data != nullptr; }
+    // True when every blob is stored raw, so mesh() never inflates.
+    bool isRaw() const { return raw; }
+    size_t meshCount() const { return count; }
+    size_t fileSize() const { return size; }
+    uint64_t sourceHash() const { return source; }
+
+    bool mesh(size_t index, MeshView &view) {
+        if(index >= count) return false;
+        MeshPackEntry e;
+        std::memcpy(&e, data + sizeof(MeshPackHeader) + index * sizeof(MeshPackEntry), sizeof(e));
+        size_t vertexBytes = static_cast<size_t>(e.vertexCount) * MeshData::STRIDE * sizeof(float);
+        view.vertexCount = e.vertexCount;
+        view.indexCount = e.indexCount;
+        view.lodCount = e.lodCount;
+        for(size_t l = 0; l < e.lodCount; ++l) {
+            view.lodIndexCount[l] = e.lodIndexCount[l];
+            view.lodError[l] = e.lodError[l];
+        }
+        view.textureIndex = e.textureIndex;
+        size_t indexBytes = view.totalIndexCount() * sizeof(uint32_t);
+        if(e.compression == MESH_PACK_RAW) {
+            view.vertices = reinterpret_cast<const float *>(data + e.vertexOffset);
+            view.indices = reinterpret_cast<const uint32_t *>(data + e.indexOffset);
+            return true;
+        }
+        if(!inflateBlob(e.vertexOffset, e.vertexSize, vertexBytes, scratchVertices) ||
+           !inflateBlob(e.indexOffset, e.indexSize, indexBytes, scratchIndices)) {
+            return false;
+        }
+        view.vertices = reinterpret_cast<const float *>(scratchVertices.data());
+        view.indices = reinterpret_cast<const uint32_t *>(scratchIndices.data());
+        return indicesInRange(view.indices, view.totalIndexCount(), e.vertexCount);
+    }
+
+private:
+    bool validate() {
+        if(size < sizeof(MeshPackHeader)) return false;
+        MeshPackHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if(std::memcmp(header.magic, "MXMB", 4) != 0 || header.version != MESH_PACK_VERSION) return false;
+        count = header.meshCount;
+        source = header.sourceHash;
+        raw = true;
+        if(count > (size - sizeof(MeshPackHeader)) / sizeof(MeshPackEntry)) return false;
+        auto inFile = [this](uint64_t offset, uint64_t blobSize) { return offset <= size && blobSize <= size - offset; };
+        for(size_t i = 0; i < count; ++i) {
+            MeshPackEntry e;
+            std::memcpy(&e, data + sizeof(MeshPackHeader) + i * sizeof(MeshPackEntry), sizeof(e));
+            if(e.vertexOffset % MESH_PACK_ALIGN != 0 || e.indexOffset % MESH_PACK_ALIGN != 0) return false;
+            if(!inFile(e.vertexOffset, e.vertexSize) || !inFile(e.indexOffset, e.indexSize)) return false;
+            if(e.lodCount > MESH_MAX_LODS) return false;
+            uint64_t indexCount = e.indexCount;
+            for(uint32_t l = 0; l < e.lodCount; ++l) indexCount += e.lodIndexCount[l];
+            uint64_t vertexBytes = static_cast<uint64_t>(e.vertexCount) * MeshData::STRIDE * sizeof(float);
+            uint64_t indexBytes = indexCount * sizeof(uint32_t);
+            if(vertexBytes > MESH_PACK_MAX_BLOB || indexBytes > MESH_PACK_MAX_BLOB) return false;
+            if(e.compression == MESH_PACK_DEFLATE &&
+               (vertexBytes > e.vertexSize * MESH_PACK_MAX_RATIO || indexBytes > e.indexSize * MESH_PACK_MAX_RATIO)) {
+                return false;
+            }
+            if(e.compression == MESH_PACK_RAW &&
+               (e.vertexSize != vertexBytes ||
+                e.indexSize != indexBytes ||
+                !indicesInRange(reinterpret_cast<const uint32_t *>(data + e.indexOffset), indexCount, e.vertexCount))) {
+                return false;
+            }
+            if(e.compression != MESH_PACK_RAW && e.compression != MESH_PACK_DEFLATE) return false;
+            if(e.compression != MESH_PACK_RAW) raw = false;
+        }
+        return true;
+    }
+
+    bool inflateBlob(uint64_t offset, uint64_t packedSize, size_t rawSize, std::vector<unsigned char> &out) {
+        out.resize(rawSize);
+        uLongf outSize = static_cast<uLongf>(rawSize);
+        return uncompress(out.data(), &outSize, data + offset, static_cast<uLong>(packedSize)) == Z_OK && outSize == rawSize;
+    }
+
+    const unsigned char *data = nullptr;
+    size_t size = 0, count = 0;
+    uint64_t source = 0;
+    bool raw = true;
+#ifndef __EMSCRIPTEN__
+    void *mapped = nullptr;
+#endif
+    std::vector<unsigned char> buffer;
+    std::vector<unsigned char> scratchVertices, scratchIndices;
+};
+
+inline bool readMeshPack(MeshPackFile &pack, ModelData &model) {
+    model.meshes.assign(pack.meshCount(), MeshData());
+    for(size_t i = 0; i < pack.meshCount(); ++i) {
+        MeshView view;
+        if(!pack.mesh(i, view)) return false;
+        MeshData &mesh = model.meshes[i];
+        mesh.vertices.assign(view.vertices, view.vertices + view.vertexCount * MeshData::STRIDE);
+        mesh.indices.assign(view.indices, view.indices + view.indexCount);
+        mesh.lods.resize(view.lodCount);
+        const uint32_t *lodIndices = view.indices + view.indexCount;
+        for(size_t l = 0; l < view.lodCount; ++l) {
+            mesh.lods[l].indices.assign(lodIndices, lodIndices + view.lodIndexCount[l]);
+            mesh.lods[l].error = view.lodError[l];
+            lodIndices += view.lodIndexCount[l];
+        }
+        mesh.textureIndex = view.textureIndex;
+    }
+    return true;
+}
+
+inline bool loadMeshPack(const std::string &filename, ModelData &model) {
+    MeshPackFile pack;
+    return pack.open(filename) && readMeshPack(pack, model);
+}
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef __MESH_SIMPLIFY_HPP_
+#define __MESH_SIMPLIFY_HPP_
+
+#include"model_data.hpp"
+#include"mesh_optimize.hpp"
+#include<algorithm>
+#include<array>
+#include<cmath>
+#include<cstdint>
+#include<cstring>
+#include<unordered_map>
+#include<vector>
+
+// Garland-Heckbert quadric error simplification by half-edge collapse: a
+// vertex only ever moves onto a neighbour, so every level of detail
+// indexes a subset of the original vertices and shares their buffer.
+// Vertices at the same position (normal or texture seams) collapse
+// together, each onto the neighbour wedge whose attributes are closest.
+// A vertex on an open border only slides along the border, held there by
+// extra planes through its border edges; where borders meet it stays put.
+// A collapse that would flip a triangle is skipped.
+struct Quadric {
+    double q[10] = {};
+
+    void addPlane(double a, double b, double c, double d) {
+        q[0] += a * a; q[1] += a * b; q[2] += a * c; q[3] += a * d;
+        q[4] += b * b; q[5] += b * c; q[6] += b * d;
+        q[7] += c * c; q[8] += c * d;
+        q[9] += d * d;
+    }
+
+    void add(const Quadric &o) {
+        for(int i = 0; i < 10; ++i) q[i] += o.q[i];
+    }
+
+    double error(const float *p) const {
+        double x = p[0], y = p[1], z = p[2];
+        double e = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+                 + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+                 + q[7] * z * z + 2 * q[8] * z
+                 + q[9];
+        return e > 0.0 ? e : 0.0;
+    }
+};
+
+// Simplifies indices (over mesh's vertices) towards targetIndexCount and
+// returns the largest collapse error, roughly a distance in model units.
+inline float simplifyIndices(const MeshData &mesh, std::vector<uint32_t> &indices, size_t targetIndexCount) {
+    size_t vertexCount = mesh.vertexCount();
+    auto pos = [&](uint32_t v) { return &mesh.vertices[v * MeshData::STRIDE]; };
+
+    // Vertices sharing a position form one collapse unit.
+    using Key = std::array<uint32_t, 3>;
+    struct KeyHash {
+        size_t operator()(const Key &k) const {
+            return (static_cast<size_t>(k[0]) * 73856093u) ^ (static_cast<size_t>(k[1]) * 19349663u) ^ (static_cast<size_t>(k[2]) * 83492791u);
+        }
+    };
+    std::unordered_map<Key, uint32_t, KeyHash> positions;
+    std::vector<uint32_t> posOf(vertexCount), wedgeStart, wedges(vertexCount);
+    std::vector<uint32_t> rep;
+    for(size_t v = 0; v < vertexCount; ++v) {
+        Key key;
+        std::memcpy(key.data(), pos(static_cast<uint32_t>(v)), sizeof(Key));
+        auto inserted = positions.emplace(key, static_cast<uint32_t>(rep.size()));
+        if(inserted.second) rep.push_back(static_cast<uint32_t>(v));
+        posOf[v] = inserted.first->second;
+    }
+    size_t posCount = rep.size();
+    wedgeStart.assign(posCount + 1, 0);
+    for(size_t v = 0; v < vertexCount; ++v) wedgeStart[posOf[v] + 1]++;
+    for(size_t p = 0; p < posCount; ++p) wedgeStart[p + 1] += wedgeStart[p];
+    {
+        std::vector<uint32_t> fill(wedgeStart.begin(), wedgeStart.end() - 1);
+        for(size_t v = 0; v < vertexCount; ++v) wedges[fill[posOf[v]]++] = static_cast<uint32_t>(v);
+    }
+
+    // Edges by position pair, counting the triangles on each; a count of
+    // one is an open border.
+    std::unordered_map<uint64_t, int> edges;
+    std::vector<uint8_t> borderEdges(posCount);
+    auto edgeKey = [](uint32_t p0, uint32_t p1) { return (static_cast<uint64_t>(std::min(p0, p1)) << 32) | std::max(p0, p1); };
+    auto findEdges = [&]() {
+        edges.clear();
+        for(size_t i = 0; i < indices.size(); ++i) {
+            uint32_t p0 = posOf[indices[i]], p1 = posOf[indices[i - i % 3 + (i + 1) % 3]];
+            if(p0 != p1) edges[edgeKey(p0, p1)]++;
+        }
+        std::fill(borderEdges.begin(), borderEdges.end(), 0);
+        for(const auto &e : edges) {
+            if(e.second != 1) continue;
+            uint32_t p0 = static_cast<uint32_t>(e.first >> 32), p1 = static_cast<uint32_t>(e.first & 0xffffffffu);
+            if(borderEdges[p0] < 255) borderEdges[p0]++;
+            if(borderEdges[p1] < 255) borderEdges[p1]++;
+        }
+    };
+    auto isBorder = [&](uint32_t p0, uint32_t p1) {
+        auto it = edges.find(edgeKey(p0, p1));
+        return it != edges.end() && it->second == 1;
+    };
+
+    std::vector<Quadric> quadrics(posCount);
+    findEdges();
+    for(size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const float *a = pos(indices[t]), *b = pos(indices[t + 1]), *c = pos(indices[t + 2]);
+        double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if(length <= 0.0) continue;
+        for(int k = 0; k < 3; ++k) n[k] /= length;
+        double d = -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]);
+        for(int k = 0; k < 3; ++k) quadrics[posOf[indices[t + k]]].addPlane(n[0], n[1], n[2], d);
+        for(int k = 0; k < 3; ++k) {
+            uint32_t p0 = posOf[indices[t + k]], p1 = posOf[indices[t + (k + 1) % 3]];
+            if(p0 == p1 || !isBorder(p0, p1)) continue;
+            const float *u = pos(indices[t + k]), *w = pos(indices[t + (k + 1) % 3]);
+            double edge[3] = { w[0] - u[0], w[1] - u[1], w[2] - u[2] };
+            double m[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+            double ml = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+            if(ml <= 0.0) continue;
+            for(int j = 0; j < 3; ++j) m[j] /= ml;
+            double md = -(m[0] * u[0] + m[1] * u[1] + m[2] * u[2]);
+            quadrics[p0].addPlane(m[0], m[1], m[2], md);
+            quadrics[p1].addPlane(m[0], m[1], m[2], md);
+        }
+    }
+    // Interior vertices go anywhere; a border vertex only along its border.
+    auto canCollapse = [&](uint32_t from, uint32_t to) {
+        if(borderEdges[from] == 0) return true;
+        return borderEdges[from] == 2 && isBorder(from, to);
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t from, to;
+    };
+    std::vector<Collapse> candidates;
+    std::vector<uint32_t> triStart, triList;
+    std::vector<char> touched(posCount);
+    std::vector<uint32_t> target(vertexCount);
+    double worst = 0.0;
+
+    auto normal = [&](const float *a, const float *b, const float *c, double *n) {
+        double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    };
+
+    for(bool first = true; indices.size() > targetIndexCount; first = false) {
+        size_t triCount = indices.size() / 3;
+        if(!first) findEdges();
+        triStart.assign(posCount + 1, 0);
+        for(uint32_t v : indices) triStart[posOf[v] + 1]++;
+        for(size_t p = 0; p < posCount; ++p) triStart[p + 1] += triStart[p];
+        triList.resize(indices.size());
+        {
+            std::vector<uint32_t> fill(triStart.begin(), triStart.end() - 1);
+            for(size_t i = 0; i < indices.size(); ++i) triList[fill[posOf[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        candidates.clear();
+        for(size_t t = 0; t < triCount; ++t) {
+            for(int k = 0; k < 3; ++k) {
+                uint32_t a = posOf[indices[t * 3 + k]], b = posOf[indices[t * 3 + (k + 1) % 3]];
+                if(a == b) continue;
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                if(canCollapse(a, b)) candidates.push_back({ q.error(pos(rep[b])), a, b });
+                if(canCollapse(b, a)) candidates.push_back({ q.error(pos(rep[a])), b, a });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+        std::fill(touched.begin(), touched.end(), 0);
+        for(size_t v = 0; v < vertexCount; ++v) target[v] = static_cast<uint32_t>(v);
+        size_t removed = 0, wanted = (indices.size() - targetIndexCount) / 3;
+        for(const Collapse &c : candidates) {
+            if(removed >= wanted) break;
+            if(touched[c.from] || touched[c.to]) continue;
+            // Reject the collapse if any remaining triangle around from
+            // would turn over.
+            bool flips = false;
+            const float *dest = pos(rep[c.to]);
+            for(uint32_t i = triStart[c.from]; i < triStart[c.from + 1] && !flips; ++i) {
+                const uint32_t *tri = &indices[triList[i] * 3];
+                const float *p[3];
+                bool hasTo = false;
+                for(int k = 0; k < 3; ++k) {
+                    p[k] = pos(tri[k]);
+                    if(posOf[tri[k]] == c.to) hasTo = true;
+                }
+                if(hasTo) continue;
+                double before[3], after[3];
+                normal(p[0], p[1], p[2], before);
+                for(int k = 0; k < 3; ++k) {
+                    if(posOf[tri[k]] == c.from) p[k] = dest;
+                }
+                normal(p[0], p[1], p[2], after);
+                if(before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0) flips = true;
+            }
+            if(flips) continue;
+            for(uint32_t i = triStart[c.from]; i < triStart[c.from + 1]; ++i) {
+                const uint32_t *tri = &indices[triList[i] * 3];
+                for(int k = 0; k < 3; ++k) touched[posOf[tri[k]]] = 1;
+                for(int k = 0; k < 3; ++k) {
+                    if(posOf[tri[k]] == c.to) {
+                        removed++;
+                        break;
+                    }
+                }
+            }
+            // Each wedge of from moves to the wedge of to with the nearest
+            // normal and texture coordinate.
+            for(uint32_t w = wedgeStart[c.from]; w < wedgeStart[c.from + 1]; ++w) {
+                uint32_t v = wedges[w];
+                const float *va = pos(v);
+                double best = -1.0;
+                for(uint32_t u = wedgeStart[c.to]; u < wedgeStart[c.to + 1]; ++u) {
+                    const float *ua = pos(wedges[u]);
+                    double d = 0.0;
+                    for(size_t k = 3; k < MeshData::STRIDE; ++k) d += (va[k] - ua[k]) * (va[k] - ua[k]);
+                    if(best < 0.0 || d < best) {
+                        best = d;
+                        target[v] = wedges[u];
+                    }
+                }
+            }
+            quadrics[c.to].add(quadrics[c.from]);
+            worst = std::max(worst, c.cost);
+        }
+        if(removed == 0) break;
+
+        size_t out = 0;
+        for(size_t t = 0; t < triCount; ++t) {
+            uint32_t a = target[indices[t * 3]], b = target[indices[t * 3 + 1]], c = target[indices[t * 3 + 2]];
+            if(posOf[a] == posOf[b] || posOf[b] == posOf[c] || posOf[a] == posOf[c]) continue;
+            indices[out++] = a;
+            indices[out++] = b;
+            indices[out++] = c;
+        }
+        indices.resize(out);
+    }
+    return static_cast<float>(std::sqrt(worst));
+}
+
+// Halves the triangle count per level, stopping at MESH_MAX_LODS or when a
+// level no longer gets meaningfully smaller (locked borders, tiny meshes).
+inline void buildMeshLods(MeshData &mesh, size_t minTriangles = 64) {
+    mesh.lods.clear();
+    std::vector<uint32_t> current = mesh.indices;
+    float error = 0.0f;
+    while(mesh.lods.size() < MESH_MAX_LODS && current.size() / 3 >= minTriangles * 2) {
+        size_t before = current.size();
+        std::vector<uint32_t> next = current;
+        error = std::max(error, simplifyIndices(mesh, next, before / 6 * 3));
+        if(next.empty() || next.size() > before * 4 / 5) break;
+        optimizeVertexCache(next, mesh.vertexCount());
+        current = next;
+        mesh.lods.push_back({ std::move(next), error });
+    }
+}
+
+inline void buildModelLods(ModelData &model) {
+    for(auto &mesh : model.meshes) buildMeshLods(mesh);
+}
+
+// loadMxmod followed by the vertex cache optimisation and levels of detail:
+// what converting a model to .mxmb goes through. Loading a model without a
+// pack only parses it; this is too slow to pay on every model switch.
+inline bool importMxmod(const std::string &filename, ModelData &model) {
+    if(!loadMxmod(filename, model)) return false;
+    optimizeModel(model);
+    buildModelLods(model);
+    return true;
+}
+
+#endif
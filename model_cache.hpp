@@ -0,0 +1,90 @@
+#ifndef __MODEL_CACHE_HPP_
+#define __MODEL_CACHE_HPP_
+
+#include"gpu_model.hpp"
+#include<cstdio>
+#include<list>
+#include<string>
+#include<unordered_map>
+
+// Uploaded models kept by key (AssetStore::key, the hash of the file) so
+// switching back to one, or to another name for the same file, is a
+// lookup. The least recently used models are released once their GPU
+// buffers exceed the budget; the newest entry always stays, even when it
+// alone is over.
+class ModelCache {
+public:
+    void setBudget(size_t bytes) {
+        budget = bytes;
+        evict();
+    }
+
+    size_t getBudget() const { return budget; }
+    size_t size() const { return entries.size(); }
+    size_t bytes() const { return total; }
+
+    GpuModel *find(const std::string &key) {
+        auto it = index.find(key);
+        if(it == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->model;
+    }
+
+    GpuModel *insert(const std::string &key, GpuModel &&model) {
+        erase(key);
+        entries.push_front(Entry{key, std::move(model)});
+        index[key] = entries.begin();
+        total += entries.front().model.bytes();
+        evict();
+        return &entries.front().model;
+    }
+
+    void erase(const std::string &key) {
+        auto it = index.find(key);
+        if(it == index.end()) return;
+        total -= it->second->model.bytes();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+        total = 0;
+    }
+
+    std::string toJSON() const {
+        char buf[192];
+        snprintf(buf, sizeof(buf), "{\"models\": %zu, \"bytes\": %zu, \"budget\": %zu, \"hits\": %zu, \"misses\": %zu, \"evictions\": %zu}",
+                 entries.size(), total, budget, hits, misses, evictions);
+        return buf;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        GpuModel model;
+    };
+
+    void evict() {
+        while(total > budget && entries.size() > 1) {
+            Entry &oldest = entries.back();
+            total -= oldest.model.bytes();
+            index.erase(oldest.key);
+            entries.pop_back();
+            evictions++;
+        }
+    }
+
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t budget = size_t(64) << 20;
+    size_t total = 0;
+    size_t hits = 0, misses = 0, evictions = 0;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef __MODEL_DATA_HPP_
+#define __MODEL_DATA_HPP_
+
+#include<zlib.h>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<string>
+#include<vector>
+
+static constexpr size_t MESH_MAX_LODS = 3;
+
+// A coarser version of a mesh that indexes the same vertices; error is
+// how far (in model units) it may stray from the full mesh.
+struct MeshLod {
+    std::vector<uint32_t> indices;
+    float error = 0.0f;
+};
+
+// CPU-side mesh in the layout the GPU gets: interleaved position (3),
+// normal (3) and texture coordinate (2) floats, matching the attribute
+// locations of sz3DVertex, plus 32-bit indices and up to MESH_MAX_LODS
+// levels of detail, finest first.
+struct MeshData {
+    static constexpr size_t STRIDE = 8;
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+    uint32_t textureIndex = 0;
+
+    size_t vertexCount() const { return vertices.size() / STRIDE; }
+
+    size_t indexCount() const {
+        size_t total = indices.size();
+        for(const auto &lod : lods) total += lod.indices.size();
+        return total;
+    }
+};
+
+struct ModelData {
+    std::vector<MeshData> meshes;
+
+    size_t bytes() const {
+        size_t total = 0;
+        for(const auto &m : meshes) total += m.vertices.size() * sizeof(float) + m.indexCount() * sizeof(uint32_t);
+        return total;
+    }
+};
+
+inline bool inflateFile(const std::string &filename, std::string &out) {
+    std::ifstream file(filename, std::ios::binary);
+    if(!file.is_open()) return false;
+    std::string packed((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    z_stream stream{};
+    if(inflateInit(&stream) != Z_OK) return false;
+    stream.next_in = reinterpret_cast<Bytef *>(packed.data());
+    stream.avail_in = static_cast<uInt>(packed.size());
+    out.clear();
+    char chunk[1 << 16];
+    int status = Z_OK;
+    while(status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef *>(chunk);
+        stream.avail_out = sizeof(chunk);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(chunk, sizeof(chunk) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+// The .mxmod text format: each mesh starts with "tri <shape> [texture]",
+// followed by "vert N", "tex N" and "norm N" blocks of N lines; '#' starts
+// a comment. Shape 1 is a triangle strip and 2 a fan, anything else a
+// triangle list. Strips and fans are turned into lists here so every mesh
+// is drawn with indexed GL_TRIANGLES.
+inline void buildIndices(MeshData &mesh, int shape) {
+    uint32_t count = static_cast<uint32_t>(mesh.vertexCount());
+    mesh.indices.clear();
+    if(shape == 1 || shape == 2) {
+        for(uint32_t i = 0; i + 2 < count; ++i) {
+            if(shape == 2) mesh.indices.insert(mesh.indices.end(), { 0, i + 1, i + 2 });
+            else if(i % 2 == 0) mesh.indices.insert(mesh.indices.end(), { i, i + 1, i + 2 });
+            else mesh.indices.insert(mesh.indices.end(), { i + 1, i, i + 2 });
+        }
+        return;
+    }
+    mesh.indices.resize(count - count % 3);
+    for(uint32_t i = 0; i < mesh.indices.size(); ++i) mesh.indices[i] = i;
+}
+
+inline bool parseMxmod(const std::string &text, ModelData &model) {
+    model.meshes.clear();
+    std::vector<int> shapes;
+    const char *p = text.c_str();
+    const char *end = p + text.size();
+    auto skipLine = [&]() {
+        while(p < end && *p != '\n') ++p;
+        if(p < end) ++p;
+    };
+    auto skipSpace = [&]() {
+        while(p < end) {
+            if(*p == '#') skipLine();
+            else if(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') ++p;
+            else break;
+        }
+    };
+    // Declared counts are not always right, so a block ends at the next
+    // keyword (or after N rows) rather than after exactly N rows.
+    auto readFloats = [&](MeshData &mesh, size_t count, size_t offset, size_t width) {
+        for(size_t i = 0; i < count; ++i) {
+            skipSpace();
+            if(p >= end || (*p >= 'a' && *p <= 'z')) break;
+            if(mesh.vertices.size() < (i + 1) * MeshData::STRIDE) mesh.vertices.resize((i + 1) * MeshData::STRIDE, 0.0f);
+            for(size_t c = 0; c < width; ++c) {
+                skipSpace();
+                char *next = nullptr;
+                float value = strtof(p, &next);
+                if(next == p) return false;
+                p = next;
+                mesh.vertices[i * MeshData::STRIDE + offset + c] = value;
+            }
+        }
+        return true;
+    };
+    while(true) {
+        skipSpace();
+        if(p >= end) break;
+        const char *word = p;
+        while(p < end && *p >= 'a' && *p <= 'z') ++p;
+        std::string keyword(word, p);
+        char *next = nullptr;
+        if(keyword == "tri") {
+            model.meshes.emplace_back();
+            shapes.push_back(static_cast<int>(strtol(p, &next, 10)));
+            p = next;
+            while(p < end && (*p == ' ' || *p == '\t')) ++p;
+            if(p < end && *p >= '0' && *p <= '9') model.meshes.back().textureIndex = static_cast<uint32_t>(strtoul(p, &next, 10));
+            skipLine();
+            continue;
+        }
+        if(model.meshes.empty() || (keyword != "vert" && keyword != "tex" && keyword != "norm")) return false;
+        size_t count = strtoul(p, &next, 10);
+        p = next;
+        skipLine();
+        MeshData &mesh = model.meshes.back();
+        bool ok = keyword == "vert" ? readFloats(mesh, count, 0, 3)
+                : keyword == "norm" ? readFloats(mesh, count, 3, 3)
+                : readFloats(mesh, count, 6, 2);
+        if(!ok) return false;
+    }
+    for(size_t i = 0; i < model.meshes.size(); ++i) buildIndices(model.meshes[i], shapes[i]);
+    return !model.meshes.empty();
+}
+
+inline bool loadMxmod(const std::string &filename, ModelData &model) {
+    std::string text;
+    return inflateFile(filename, text) && parseMxmod(text, model);
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef __MODEL_INSTANCES_HPP_
+#define __MODEL_INSTANCES_HPP_
+
+#include"gpu_model.hpp"
+#include"frustum.hpp"
+#include<algorithm>
+#include<array>
+#include<cmath>
+#include<cstdint>
+#include<vector>
+
+// Copies of one model filling a lattice around the origin, nearest cells
+// first. Each copy is scaled to unit radius and turned about its own
+// axis, and may carry a time offset that instanced effects add to
+// time_f. Drawing sorts the visible copies by level of detail, so the
+// whole field takes one instanced draw per level (per index range when
+// meshes have different numbers of levels).
+class InstanceField {
+public:
+    struct Stats {
+        size_t drawn = 0;
+        size_t culled = 0;
+        size_t triangles = 0;
+        int calls = 0;
+        std::array<size_t, MESH_MAX_LODS + 1> perLevel{};
+    };
+
+    void build(const GpuModel &model, size_t count, float timeSpread) {
+        clear();
+        if(count == 0 || model.empty()) return;
+        float center[3];
+        float radius = std::max(model.sphere(center), 1e-6f);
+        float scale = 1.0f / radius;
+        int side = 1;
+        while(static_cast<size_t>(side) * side * side - 1 < count) side += 2;
+        int half = side / 2;
+        std::vector<std::array<int, 3>> cells;
+        cells.reserve(static_cast<size_t>(side) * side * side);
+        for(int x = -half; x <= half; ++x)
+            for(int y = -half; y <= half; ++y)
+                for(int z = -half; z <= half; ++z)
+                    if(x != 0 || y != 0 || z != 0) cells.push_back({ x, y, z });
+        std::stable_sort(cells.begin(), cells.end(), [](const std::array<int, 3> &a, const std::array<int, 3> &b) {
+            return a[0] * a[0] + a[1] * a[1] + a[2] * a[2] < b[0] * b[0] + b[1] * b[1] + b[2] * b[2];
+        });
+        instances.resize(count * GpuModel::INSTANCE_FLOATS);
+        bounds.resize(count);
+        uint32_t seed = 0x9e3779b9u;
+        auto random = [&seed]() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return static_cast<float>(seed & 0xffffffu) / static_cast<float>(0x1000000);
+        };
+        const float extent[3] = { 1.0f, 1.0f, 1.0f };
+        for(size_t i = 0; i < count; ++i) {
+            float position[3];
+            for(int k = 0; k < 3; ++k) position[k] = cells[i][k] * SPACING;
+            float axis[3] = { random() - 0.5f, random() - 0.5f, random() - 0.5f };
+            float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+            if(length < 1e-3f) {
+                axis[0] = axis[2] = 0.0f;
+                axis[1] = length = 1.0f;
+            }
+            for(float &a : axis) a /= length;
+            float angle = random() * 6.2831853f;
+            float *m = &instances[i * GpuModel::INSTANCE_FLOATS];
+            rotation(axis, angle, m);
+            for(int c = 0; c < 3; ++c)
+                for(int r = 0; r < 3; ++r) m[c * 4 + r] *= scale;
+            for(int r = 0; r < 3; ++r) m[12 + r] = position[r] - (m[r] * center[0] + m[4 + r] * center[1] + m[8 + r] * center[2]);
+            m[15] = 1.0f;
+            m[16] = timeSpread * random();
+            bounds.set(i, position, 1.0f, extent);
+        }
+        instanceScale = scale;
+        levelCount = 1;
+        for(const auto &mesh : model.meshes) levelCount = std::max(levelCount, mesh.levels);
+        levelError.fill(0.0f);
+        for(int l = 0; l < levelCount; ++l) {
+            for(const auto &mesh : model.meshes) levelError[l] = std::max(levelError[l], mesh.levelError[std::min(l, mesh.levels - 1)]);
+        }
+    }
+
+    void clear() {
+        instances.clear();
+        bounds.resize(0);
+    }
+
+    size_t size() const { return bounds.count; }
+
+    // Each copy takes the coarsest level whose largest mesh error, in
+    // pixels at the near side of the copy, stays under threshold.
+    Stats draw(GpuModel &model, const Frustum &frustum, const float *eye, float pixelScale, float threshold) {
+        Stats stats;
+        stats.culled = cullMeshes(frustum, bounds, visible);
+        levels.assign(size(), -1);
+        std::array<size_t, MESH_MAX_LODS + 2> first{};
+        for(size_t i = 0; i < size(); ++i) {
+            if(!visible[i]) continue;
+            int level = 0;
+            if(threshold > 0.0f) {
+                float dx = bounds.x[i] - eye[0], dy = bounds.y[i] - eye[1], dz = bounds.z[i] - eye[2];
+                float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - bounds.radius[i];
+                if(distance > 0.01f) {
+                    float pixelsPerUnit = instanceScale * pixelScale / distance;
+                    while(level + 1 < levelCount && levelError[level + 1] * pixelsPerUnit < threshold) level++;
+                }
+            }
+            levels[i] = level;
+            first[level + 1]++;
+        }
+        for(int l = 0; l < levelCount; ++l) first[l + 1] += first[l];
+        stats.drawn = first[levelCount];
+        if(stats.drawn == 0) return stats;
+        staging.resize(stats.drawn * GpuModel::INSTANCE_FLOATS);
+        std::array<size_t, MESH_MAX_LODS + 2> next = first;
+        for(size_t i = 0; i < size(); ++i) {
+            if(levels[i] < 0) continue;
+            std::copy_n(&instances[i * GpuModel::INSTANCE_FLOATS], GpuModel::INSTANCE_FLOATS, &staging[next[levels[i]]++ * GpuModel::INSTANCE_FLOATS]);
+        }
+        model.uploadInstances(staging.data(), stats.drawn);
+        meshLevels.resize(model.meshes.size());
+        for(int l = 0; l < levelCount; ++l) {
+            size_t count = first[l + 1] - first[l];
+            if(count == 0) continue;
+            for(size_t m = 0; m < meshLevels.size(); ++m) {
+                meshLevels[m] = std::min(l, model.meshes[m].levels - 1);
+                stats.triangles += count * (model.meshes[m].levelCount[meshLevels[m]] / 3);
+            }
+            stats.perLevel[l] = count;
+            stats.calls += model.draw(meshLevels.data(), static_cast<GLsizei>(count), first[l]);
+        }
+        return stats;
+    }
+
+private:
+    static constexpr float SPACING = 3.0f;
+
+    // Column-major rotation of angle radians about a unit axis.
+    static void rotation(const float *axis, float angle, float *m) {
+        float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+        float x = axis[0], y = axis[1], z = axis[2];
+        const float values[16] = {
+            t * x * x + c,     t * x * y + s * z, t * x * z - s * y, 0.0f,
+            t * x * y - s * z, t * y * y + c,     t * y * z + s * x, 0.0f,
+            t * x * z + s * y, t * y * z - s * x, t * z * z + c,     0.0f,
+            0.0f,              0.0f,              0.0f,              1.0f
+        };
+        std::copy(values, values + 16, m);
+    }
+
+    std::vector<float> instances;
+    MeshBounds bounds;
+    float instanceScale = 1.0f;
+    int levelCount = 1;
+    std::array<float, MESH_MAX_LODS + 1> levelError{};
+    std::vector<uint8_t> visible;
+    std::vector<int> levels;
+    std::vector<float> staging;
+    std::vector<int> meshLevels;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef __MODEL_LOADER_HPP_
+#define __MODEL_LOADER_HPP_
+
+#include"model_data.hpp"
+#include"mesh_pack.hpp"
+#include"gpu_model.hpp"
+#include"mesh_optimize.hpp"
+#include<chrono>
+#include<exception>
+#include<memory>
+#include<string>
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define MX_MODEL_THREAD 1
+#include<condition_variable>
+#include<mutex>
+#include<thread>
+#endif
+
+// A model read into memory and ready for one upload on the GL thread. A
+// raw .mxmb stays mapped and is uploaded straight from the file; anything
+// else is inflated and parsed into data. hash is the FNV-1a of the file
+// at path, taken on the reading thread so the cache can be keyed by
+// content without hashing on the GL thread.
+struct LoadedModel {
+    std::string path;
+    uint64_t hash = 0;
+    std::unique_ptr<MeshPackFile> pack;
+    ModelData data;
+    bool ok = false;
+    double ms = 0.0;
+
+    bool upload(GpuModel &model, bool quantize = false) {
+        return pack ? model.upload(*pack, quantize) : model.upload(data, quantize);
+    }
+};
+
+inline bool readModel(const std::string &path, LoadedModel &out) {
+    auto start = std::chrono::steady_clock::now();
+    out.path = path;
+    // This runs on the loader thread, where nothing else would catch e.g.
+    // a bad_alloc from a damaged file.
+    try {
+        out.hash = meshPackSourceHash(path);
+        auto pack = std::make_unique<MeshPackFile>();
+        if(openMeshPackFor(path, *pack, out.hash) || pack->open(path)) {
+            if(pack->isRaw()) {
+                out.pack = std::move(pack);
+                out.ok = true;
+            } else {
+                out.ok = readMeshPack(*pack, out.data);
+            }
+        } else {
+            out.ok = loadMxmod(path, out.data);
+        }
+    } catch (const std::exception &) {
+        out.pack.reset();
+        out.data = ModelData();
+        out.ok = false;
+    }
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return out.ok;
+}
+
+// Reads models on a worker thread (a pthread in the browser when built
+// with THREADS=1). Only the latest request matters: a request made while
+// another is being read replaces it, and the stale result is dropped.
+// Without threads the read is deferred to the next poll(), so it still
+// happens at the top of a frame rather than inside the JS callback.
+class ModelLoader {
+public:
+    ModelLoader() = default;
+    ~ModelLoader() { stop(); }
+    ModelLoader(const ModelLoader &) = delete;
+    ModelLoader &operator=(const ModelLoader &) = delete;
+
+    void request(const std::string &path) {
+#ifdef MX_MODEL_THREAD
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!worker.joinable()) worker = std::thread([this]() { run(); });
+        ready.reset();
+        generation++;
+#endif
+        pending = path;
+        hasPending = true;
+#ifdef MX_MODEL_THREAD
+        wake.notify_one();
+#endif
+    }
+
+    void cancel() {
+#ifdef MX_MODEL_THREAD
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.reset();
+        generation++;
+#endif
+        hasPending = false;
+    }
+
+    // True when a requested model has been read; out then holds it.
+    bool poll(LoadedModel &out) {
+#ifdef MX_MODEL_THREAD
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!ready) return false;
+        out = std::move(*ready);
+        ready.reset();
+        return true;
+#else
+        if(!hasPending) return false;
+        hasPending = false;
+        out = LoadedModel();
+        readModel(pending, out);
+        return true;
+#endif
+    }
+
+    bool busy() const {
+#ifdef MX_MODEL_THREAD
+        std::lock_guard<std::mutex> lock(mutex);
+        return hasPending || reading || ready;
+#else
+        return hasPending;
+#endif
+    }
+
+    void stop() {
+#ifdef MX_MODEL_THREAD
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        if(worker.joinable()) worker.join();
+#endif
+    }
+
+private:
+#ifdef MX_MODEL_THREAD
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            wake.wait(lock, [this]() { return quit || hasPending; });
+            if(quit) break;
+            std::string path = pending;
+            size_t current = generation;
+            hasPending = false;
+            reading = true;
+            lock.unlock();
+            auto result = std::make_unique<LoadedModel>();
+            readModel(path, *result);
+            lock.lock();
+            reading = false;
+            if(current == generation) ready = std::move(result);
+        }
+    }
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::unique_ptr<LoadedModel> ready;
+    size_t generation = 0;
+    bool reading = false;
+    bool quit = false;
+#endif
+    std::string pending;
+    bool hasPending = false;
+};
+
+#endif
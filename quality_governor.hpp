@@ -0,0 +1,127 @@
+#ifndef __QUALITY_GOVERNOR_HPP_
+#define __QUALITY_GOVERNOR_HPP_
+
+#include<algorithm>
+#include<cmath>
+#include<cstdlib>
+#include<fstream>
+#include<map>
+#include<sstream>
+#include<string>
+
+// Closed-loop control of iQuality. Each effect starts at the level it
+// settled on last time (or the ceiling, normally the user's Quality
+// slider) and moves one step at a time: down when the smoothed frame time
+// is over budget, up when there is clear headroom. A raise that immediately
+// has to be undone caps that effect for the rest of the visit so the level
+// does not bounce between two steps.
+class QualityGovernor {
+public:
+    static constexpr float STEP = 0.1f;
+    static constexpr int SETTLE_FRAMES = 20;
+
+    void setEnabled(bool value) {
+        enabled = value;
+        restart();
+    }
+    bool isEnabled() const { return enabled; }
+
+    void setTargetMs(double ms) { if(ms > 0.0) targetMs = ms; }
+    double getTargetMs() const { return targetMs; }
+
+    void setCeiling(float value) {
+        maxQuality = std::max(minQuality, value);
+        quality = std::min(quality, maxQuality);
+    }
+
+    float getCeiling() const { return maxQuality; }
+    float getQuality() const { return quality; }
+    bool atFloor() const { return quality <= minQuality + STEP * 0.5f; }
+
+    // Makes name the current effect and returns the level to start it at.
+    float select(const std::string &name) {
+        effect = name;
+        restart();
+        auto it = learned.find(name);
+        quality = it != learned.end() ? std::clamp(it->second, minQuality, maxQuality) : maxQuality;
+        return quality;
+    }
+
+    // Returns true when the quality changed.
+    bool addSample(double ms) {
+        if(!enabled || effect.empty() || ms <= 0.0) return false;
+        averageMs = samples == 0 ? ms : averageMs + (ms - averageMs) * 0.2;
+        if(++samples < SETTLE_FRAMES) return false;
+        float next = quality;
+        if(averageMs > targetMs * 1.1) {
+            if(raised) cap = quality;
+            next -= STEP;
+        } else if(averageMs < targetMs * 0.75 && quality + STEP < cap - STEP * 0.5f) {
+            next += STEP;
+        }
+        raised = false;
+        next = std::clamp(std::round(next / STEP) * STEP, minQuality, maxQuality);
+        if(std::fabs(next - quality) < STEP * 0.5f) return false;
+        raised = next > quality;
+        quality = next;
+        learned[effect] = quality;
+        samples = 0;
+        return true;
+    }
+
+    // One "name<TAB>quality" line per effect that has moved off the ceiling.
+    std::string serialize() const {
+        std::ostringstream out;
+        for(const auto &entry : learned) {
+            out << entry.first << '\t' << entry.second << '\n';
+        }
+        return out.str();
+    }
+
+    void deserialize(const std::string &text) {
+        std::istringstream in(text);
+        std::string line;
+        while(std::getline(in, line)) {
+            size_t tab = line.rfind('\t');
+            if(tab == std::string::npos || tab == 0) continue;
+            learned[line.substr(0, tab)] = static_cast<float>(atof(line.c_str() + tab + 1));
+        }
+    }
+
+    bool load(const std::string &filename) {
+        std::ifstream file(filename);
+        if(!file.is_open()) return false;
+        std::ostringstream text;
+        text << file.rdbuf();
+        deserialize(text.str());
+        return true;
+    }
+
+    bool save(const std::string &filename) const {
+        std::ofstream file(filename);
+        if(!file.is_open()) return false;
+        file << serialize();
+        return true;
+    }
+
+private:
+    void restart() {
+        samples = 0;
+        averageMs = 0.0;
+        raised = false;
+        cap = 1.0e9f;
+    }
+
+    bool enabled = false;
+    double targetMs = 1000.0 / 60.0;
+    float minQuality = 0.5f, maxQuality = 1.0f;
+    float quality = 1.0f;
+    float cap = 1.0e9f;
+    bool raised = false;
+    double averageMs = 0.0;
+    int samples = 0;
+    std::string effect;
+    std::map<std::string, float> learned;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef __RENDER_TARGET_HPP_
+#define __RENDER_TARGET_HPP_
+
+#include"gl.hpp"
+#include<algorithm>
+#include<memory>
+#include<vector>
+
+class RenderTarget {
+public:
+    RenderTarget() = default;
+    ~RenderTarget() { release(); }
+    RenderTarget(const RenderTarget &) = delete;
+    RenderTarget &operator=(const RenderTarget &) = delete;
+
+    bool create(int w, int h, bool withDepth, GLenum internalFormat = GL_RGBA8) {
+        release();
+        width = w;
+        height = h;
+        format = internalFormat;
+        hasDepth = withDepth;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, internalFormat == GL_RGB8 ? GL_RGB : GL_RGBA, internalFormat == GL_RGBA16F ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE, nullptr);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        if(withDepth) {
+            glGenRenderbuffers(1, &depth);
+            glBindRenderbuffer(GL_RENDERBUFFER, depth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        }
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if(status != GL_FRAMEBUFFER_COMPLETE) {
+            printf("RenderTarget: framebuffer incomplete (0x%x) for %dx%d\n", status, w, h);
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    void release() {
+        if(depth != 0) glDeleteRenderbuffers(1, &depth);
+        if(texture != 0) glDeleteTextures(1, &texture);
+        if(fbo != 0) glDeleteFramebuffers(1, &fbo);
+        fbo = texture = depth = 0;
+        width = height = 0;
+    }
+
+    void bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+    }
+
+    static void unbind() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    bool valid() const { return fbo != 0; }
+    GLuint getFramebuffer() const { return fbo; }
+    GLuint getTexture() const { return texture; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    GLenum getFormat() const { return format; }
+    bool getHasDepth() const { return hasDepth; }
+
+private:
+    GLuint fbo = 0, texture = 0, depth = 0;
+    int width = 0, height = 0;
+    GLenum format = GL_RGBA8;
+    bool hasDepth = false;
+};
+
+// Reuses framebuffers between frames. Targets are matched on size, format
+// and depth attachment; acquire only allocates when every matching target
+// is already in use, so a steady-state frame allocates nothing.
+class RenderTargetPool {
+public:
+    RenderTarget *acquire(int w, int h, GLenum internalFormat, bool withDepth) {
+        for(auto &e : entries) {
+            RenderTarget &t = *e.target;
+            if(!e.inUse && t.getWidth() == w && t.getHeight() == h && t.getFormat() == internalFormat && t.getHasDepth() == withDepth) {
+                e.inUse = true;
+                return e.target.get();
+            }
+        }
+        auto target = std::make_unique<RenderTarget>();
+        if(!target->create(w, h, withDepth, internalFormat)) {
+            return nullptr;
+        }
+        entries.push_back({std::move(target), true});
+        return entries.back().target.get();
+    }
+
+    void release(RenderTarget *target) {
+        for(auto &e : entries) {
+            if(e.target.get() == target) {
+                e.inUse = false;
+                return;
+            }
+        }
+    }
+
+    // Drops idle targets, e.g. after a resize left old sizes behind.
+    void trim() {
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry &e) { return !e.inUse; }), entries.end());
+    }
+
+    size_t size() const { return entries.size(); }
+
+private:
+    struct Entry {
+        std::unique_ptr<RenderTarget> target;
+        bool inUse = false;
+    };
+    std::vector<Entry> entries;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef __RESOLUTION_SCALER_HPP_
+#define __RESOLUTION_SCALER_HPP_
+
+#include"bench.hpp"
+#include<algorithm>
+#include<array>
+#include<cmath>
+
+// GL_TIME_ELAPSED queries kept in a small ring and read back a few frames
+// later, once the driver reports them available, so timing never stalls
+// the pipeline the way FrameTimer's glFinish fallback does.
+class GpuFrameClock {
+public:
+    GpuFrameClock() = default;
+    GpuFrameClock(const GpuFrameClock &) = delete;
+    GpuFrameClock &operator=(const GpuFrameClock &) = delete;
+    ~GpuFrameClock() { release(); }
+
+    bool init() {
+        if(initialized) return available;
+        initialized = true;
+        available = hasGpuTimer();
+        disjointQuery = available && hasDisjointQuery();
+        if(available) glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+        return available;
+    }
+
+    void release() {
+        if(available) glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+        available = initialized = false;
+        head = inFlight = 0;
+        running = false;
+    }
+
+    bool isAvailable() const { return available; }
+
+    void begin() {
+        if(!available || inFlight == queries.size()) return;
+        glBeginQuery(GL_TIME_ELAPSED_EXT, queries[head]);
+        running = true;
+    }
+
+    void end() {
+        if(!running) return;
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        running = false;
+        head = (head + 1) % queries.size();
+        inFlight++;
+    }
+
+    enum class Sample { Pending, Ready, Skipped };
+
+    // Takes the oldest finished query. A sample taken across a disjoint
+    // event (e.g. a GPU clock change) is Skipped; later ones may still be
+    // ready, so callers keep polling until Pending.
+    Sample poll(double &ms) {
+        if(inFlight == 0) return Sample::Pending;
+        size_t tail = (head + queries.size() - inFlight) % queries.size();
+        GLuint ready = 0;
+        glGetQueryObjectuiv(queries[tail], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if(!ready) return Sample::Pending;
+        bool disjoint = disjointQuery && gpuDisjoint();
+        GLuint64 ns = queryNanoseconds(queries[tail]);
+        inFlight--;
+        if(disjoint) return Sample::Skipped;
+        ms = ns / 1.0e6;
+        return Sample::Ready;
+    }
+
+private:
+    std::array<GLuint, 4> queries{};
+    size_t head = 0, inFlight = 0;
+    bool initialized = false, available = false, running = false;
+    bool disjointQuery = false;
+};
+
+// Picks the render scale for the next frame from measured frame time.
+// The scale only drops when the smoothed time is well over budget and only
+// rises when it is well under, and each change waits for fresh samples, so
+// the resolution does not flicker around the target. When the frame time
+// sits inside the band (e.g. pinned by vsync) a step up is probed now and
+// then; a probe that goes over budget doubles the wait before the next one.
+class ResolutionScaler {
+public:
+    static constexpr float STEP = 0.05f;
+    static constexpr int SETTLE_FRAMES = 30;
+    static constexpr int PROBE_FRAMES = 240;
+    static constexpr int MAX_PROBE_FRAMES = 3840;
+
+    void setEnabled(bool value) {
+        enabled = value;
+        restart();
+        if(!enabled) scale = maxScale;
+    }
+    bool isEnabled() const { return enabled; }
+
+    void setTargetMs(double ms) { if(ms > 0.0) targetMs = ms; }
+    double getTargetMs() const { return targetMs; }
+
+    void setRange(float minValue, float maxValue) {
+        minScale = std::clamp(minValue, 0.1f, 1.0f);
+        maxScale = std::clamp(maxValue, minScale, 1.0f);
+        scale = std::clamp(scale, minScale, maxScale);
+    }
+    float getMinScale() const { return minScale; }
+    float getMaxScale() const { return maxScale; }
+
+    float getScale() const { return enabled ? scale : 1.0f; }
+    double getAverageMs() const { return averageMs; }
+
+    // Returns true when the scale changed.
+    bool addSample(double ms) {
+        if(!enabled || ms <= 0.0) return false;
+        averageMs = samples == 0 ? ms : averageMs + (ms - averageMs) * 0.1;
+        if(++samples < SETTLE_FRAMES) return false;
+        if(averageMs > targetMs * 1.1) {
+            if(probing) probeFrames = std::min(probeFrames * 2, MAX_PROBE_FRAMES);
+            // Cost follows pixel count, which goes with the square of scale.
+            return apply(scale * static_cast<float>(std::sqrt(targetMs / averageMs)));
+        }
+        if(averageMs < targetMs * 0.75) {
+            probeFrames = PROBE_FRAMES;
+            return apply(scale + STEP);
+        }
+        if(probing) {
+            probing = false;
+            probeFrames = PROBE_FRAMES;
+        }
+        if(scale < maxScale && samples >= probeFrames) {
+            bool changed = apply(scale + STEP);
+            probing = changed;
+            return changed;
+        }
+        return false;
+    }
+
+private:
+    bool apply(float next) {
+        next = std::clamp(std::round(next / STEP) * STEP, minScale, maxScale);
+        probing = false;
+        if(std::fabs(next - scale) < STEP * 0.5f) return false;
+        scale = next;
+        samples = 0;
+        return true;
+    }
+
+    void restart() {
+        samples = 0;
+        averageMs = 0.0;
+        probing = false;
+        probeFrames = PROBE_FRAMES;
+    }
+
+    bool enabled = false;
+    double targetMs = 1000.0 / 60.0;
+    float minScale = 0.5f, maxScale = 1.0f;
+    float scale = 1.0f;
+    double averageMs = 0.0;
+    int samples = 0;
+    int probeFrames = PROBE_FRAMES;
+    bool probing = false;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef __SCREEN_QUAD_HPP_
+#define __SCREEN_QUAD_HPP_
+
+#include"gl.hpp"
+#include<array>
+
+// Vertex arrays for the handful of rects the 2D path draws: the display
+// rect on the canvas, full targets and thumbnail cells. Vertices are in
+// clip space, so a rect that fills its surface is the same quad at any
+// size, and each distinct rect is uploaded once and then reused. A frame
+// that draws the same rects as the last one binds a VAO and draws; it
+// uploads nothing. Texture coordinates put (0,0) at the bottom left,
+// matching textures uploaded flipped and render targets.
+class ScreenQuads {
+public:
+    static constexpr size_t SLOTS = 8;
+
+    ScreenQuads() = default;
+    ~ScreenQuads() { release(); }
+    ScreenQuads(const ScreenQuads &) = delete;
+    ScreenQuads &operator=(const ScreenQuads &) = delete;
+
+    void release() {
+        for(auto &slot : slots) {
+            if(slot.vao != 0) glDeleteVertexArrays(1, &slot.vao);
+            if(slot.vbo != 0) glDeleteBuffers(1, &slot.vbo);
+            slot = Slot();
+        }
+        next = 0;
+        uploads = 0;
+    }
+
+    // Size of the framebuffer (or viewport) the rects are given in.
+    void setSurface(int w, int h) {
+        surfaceW = w;
+        surfaceH = h;
+    }
+
+    // x, y is the top-left corner, as for GLSprite.
+    void draw(GLuint program, int x, int y, int w, int h) {
+        if(surfaceW <= 0 || surfaceH <= 0) return;
+        std::array<float, 4> rect = {
+            static_cast<float>(x) / surfaceW * 2.0f - 1.0f,
+            1.0f - static_cast<float>(y + h) / surfaceH * 2.0f,
+            static_cast<float>(x + w) / surfaceW * 2.0f - 1.0f,
+            1.0f - static_cast<float>(y) / surfaceH * 2.0f
+        };
+        if(program != layoutProgram) findAttributes(program);
+        Slot &slot = find(rect);
+        glBindVertexArray(slot.vao);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindVertexArray(0);
+    }
+
+    size_t getUploads() const { return uploads; }
+
+private:
+    struct Slot {
+        GLuint vao = 0, vbo = 0;
+        std::array<float, 4> rect{};
+        GLint position = -1, texCoord = -1;
+    };
+
+    // The 2D programs share one vertex shader, so this normally runs once;
+    // the locations are looked up by type (vec3/vec4 position, vec2
+    // coordinate) rather than by name.
+    void findAttributes(GLuint program) {
+        layoutProgram = program;
+        GLint count = 0;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        position = texCoord = -1;
+        for(GLint i = 0; i < count; ++i) {
+            char name[64];
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(program, static_cast<GLuint>(i), sizeof(name), &length, &size, &type, name);
+            GLint location = glGetAttribLocation(program, name);
+            if((type == GL_FLOAT_VEC3 || type == GL_FLOAT_VEC4) && position < 0) position = location;
+            else if(type == GL_FLOAT_VEC2 && texCoord < 0) texCoord = location;
+        }
+    }
+
+    Slot &find(const std::array<float, 4> &rect) {
+        for(auto &slot : slots) {
+            if(slot.vao != 0 && slot.rect == rect) {
+                if(slot.position != position || slot.texCoord != texCoord) setAttributes(slot);
+                return slot;
+            }
+        }
+        Slot &slot = slots[next];
+        next = (next + 1) % SLOTS;
+        if(slot.vao == 0) {
+            glGenVertexArrays(1, &slot.vao);
+            glGenBuffers(1, &slot.vbo);
+        }
+        slot.rect = rect;
+        float vertices[] = {
+            rect[0], rect[1], 0.0f, 0.0f, 0.0f,
+            rect[2], rect[1], 0.0f, 1.0f, 0.0f,
+            rect[0], rect[3], 0.0f, 0.0f, 1.0f,
+            rect[2], rect[3], 0.0f, 1.0f, 1.0f
+        };
+        glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        uploads++;
+        setAttributes(slot);
+        return slot;
+    }
+
+    void setAttributes(Slot &slot) {
+        glBindVertexArray(slot.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+        if(slot.position >= 0) glDisableVertexAttribArray(slot.position);
+        if(slot.texCoord >= 0) glDisableVertexAttribArray(slot.texCoord);
+        if(position >= 0) {
+            glEnableVertexAttribArray(position);
+            glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void *>(0));
+        }
+        if(texCoord >= 0) {
+            glEnableVertexAttribArray(texCoord);
+            glVertexAttribPointer(texCoord, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void *>(3 * sizeof(float)));
+        }
+        slot.position = position;
+        slot.texCoord = texCoord;
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    std::array<Slot, SLOTS> slots;
+    size_t next = 0;
+    size_t uploads = 0;
+    int surfaceW = 0, surfaceH = 0;
+    GLuint layoutProgram = 0;
+    GLint position = -1, texCoord = -1;
+};
+
+#endif
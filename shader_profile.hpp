@@ -0,0 +1,191 @@
+#ifndef __SHADER_PROFILE_HPP_
+#define __SHADER_PROFILE_HPP_
+
+#include"gl.hpp"
+#include"bench.hpp"
+#include<algorithm>
+#include<chrono>
+#include<fstream>
+#include<ostream>
+#include<sstream>
+#include<string>
+#include<vector>
+
+struct ShaderCompileRecord {
+    std::string name;
+    std::string variant;
+    size_t source_bytes = 0;
+    double load_ms = 0.0;
+    double compile_ms = -1.0;
+    double link_ms = -1.0;
+    bool ok = false;
+    std::string stage;
+    std::string error;
+};
+
+// Records the startup cost of every effect. load_ms is the wall time of
+// gl::ShaderProgram::loadProgramFromText and is always collected. The
+// separate compile/link split needs a second, raw compile of the same
+// sources, so it only runs in detailed mode or to capture the log of a
+// program that failed.
+class ShaderProfiler {
+public:
+    static ShaderProfiler &instance() {
+        static ShaderProfiler profiler;
+        return profiler;
+    }
+
+    void setDetailed(bool value) { detailed = value; }
+    bool isDetailed() const { return detailed; }
+    void setOutputPrefix(const std::string &prefix) { outputPrefix = prefix; }
+
+    template<typename F>
+    bool load(const std::string &name, const std::string &variant, const std::string &vertex, const std::string &fragment, F &&loader) {
+        ShaderCompileRecord rec;
+        rec.name = name;
+        rec.variant = variant;
+        rec.source_bytes = fragment.size();
+        auto start = std::chrono::steady_clock::now();
+        rec.ok = loader();
+        rec.load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(detailed || !rec.ok) {
+            measure(rec, vertex, fragment);
+        }
+        records.push_back(std::move(rec));
+        return records.back().ok;
+    }
+
+    void measure(ShaderCompileRecord &rec, const std::string &vertex, const std::string &fragment) {
+        auto t0 = std::chrono::steady_clock::now();
+        GLuint vs = compile(GL_VERTEX_SHADER, vertex, rec, "vertex");
+        GLuint fs = compile(GL_FRAGMENT_SHADER, fragment, rec, "fragment");
+        auto t1 = std::chrono::steady_clock::now();
+        rec.compile_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        if(vs != 0 && fs != 0) {
+            GLuint program = glCreateProgram();
+            glAttachShader(program, vs);
+            glAttachShader(program, fs);
+            glLinkProgram(program);
+            GLint status = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            rec.link_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+            if(!status && rec.stage.empty()) {
+                rec.stage = "link";
+                rec.error = programLog(program);
+            }
+            glDeleteProgram(program);
+        }
+        if(vs != 0) glDeleteShader(vs);
+        if(fs != 0) glDeleteShader(fs);
+    }
+
+    void writeCSV(std::ostream &out) const {
+        out << "name,variant,source_bytes,load_ms,compile_ms,link_ms,ok,stage,error\n";
+        for(const auto &r : records) {
+            out << csvField(r.name) << "," << r.variant << "," << r.source_bytes << ","
+                << r.load_ms << "," << r.compile_ms << "," << r.link_ms << ","
+                << (r.ok ? 1 : 0) << "," << r.stage << "," << csvField(r.error) << "\n";
+        }
+    }
+
+    void writeJSON(std::ostream &out) const {
+        out << "{\n  \"detailed\": " << (detailed ? "true" : "false") << ",\n  \"shaders\": [\n";
+        char buf[256];
+        for(size_t i = 0; i < records.size(); ++i) {
+            const auto &r = records[i];
+            snprintf(buf, sizeof(buf), "\"source_bytes\": %zu, \"load_ms\": %.3f, \"compile_ms\": %.3f, \"link_ms\": %.3f, \"ok\": %s",
+                     r.source_bytes, r.load_ms, r.compile_ms, r.link_ms, r.ok ? "true" : "false");
+            out << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"variant\": \"" << r.variant << "\", " << buf
+                << ", \"stage\": \"" << r.stage << "\", \"error\": \"" << jsonEscape(r.error) << "\"}"
+                << (i + 1 < records.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    std::string toCSV() const {
+        std::ostringstream out;
+        writeCSV(out);
+        return out.str();
+    }
+
+    std::string toJSON() const {
+        std::ostringstream out;
+        writeJSON(out);
+        return out.str();
+    }
+
+    double totalLoadMs() const {
+        double total = 0.0;
+        for(const auto &r : records) total += r.load_ms;
+        return total;
+    }
+
+    void finish() {
+        if(records.empty() || outputPrefix.empty()) return;
+        std::ofstream csv(outputPrefix + ".csv");
+        writeCSV(csv);
+        std::ofstream json(outputPrefix + ".json");
+        writeJSON(json);
+        printf("ShaderProfiler: %zu programs, %.1f ms total, written to %s.csv/.json\n",
+               records.size(), totalLoadMs(), outputPrefix.c_str());
+        std::vector<const ShaderCompileRecord *> slowest;
+        for(const auto &r : records) slowest.push_back(&r);
+        size_t top = std::min<size_t>(10, slowest.size());
+        std::partial_sort(slowest.begin(), slowest.begin() + top, slowest.end(),
+                          [](const ShaderCompileRecord *a, const ShaderCompileRecord *b) { return a->load_ms > b->load_ms; });
+        for(size_t i = 0; i < top; ++i) {
+            printf("  %8.2f ms  %s (%s)\n", slowest[i]->load_ms, slowest[i]->name.c_str(), slowest[i]->variant.c_str());
+        }
+    }
+
+    const std::vector<ShaderCompileRecord> &getRecords() const { return records; }
+
+private:
+    ShaderProfiler() = default;
+
+    GLuint compile(GLenum type, const std::string &source, ShaderCompileRecord &rec, const char *stage) {
+        GLuint shader = glCreateShader(type);
+        const char *src = source.c_str();
+        glShaderSource(shader, 1, &src, nullptr);
+        glCompileShader(shader);
+        GLint status = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if(!status) {
+            if(rec.stage.empty()) {
+                rec.stage = stage;
+                GLint len = 0;
+                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+                std::string log(len > 0 ? len : 0, '\0');
+                if(len > 0) glGetShaderInfoLog(shader, len, nullptr, &log[0]);
+                rec.error = log.c_str();
+            }
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    static std::string programLog(GLuint program) {
+        GLint len = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+        std::string log(len > 0 ? len : 0, '\0');
+        if(len > 0) glGetProgramInfoLog(program, len, nullptr, &log[0]);
+        return log.c_str();
+    }
+
+    static std::string csvField(const std::string &text) {
+        std::string out = "\"";
+        for(char c : text) {
+            if(c == '"') out += "\"\"";
+            else if(c == '\n' || c == '\r') out += ' ';
+            else out += c;
+        }
+        return out + "\"";
+    }
+
+    bool detailed = false;
+    std::string outputPrefix;
+    std::vector<ShaderCompileRecord> records;
+};
+
+#endif
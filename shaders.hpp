@@ -22,8 +22,12 @@ uniform float iQuality;
 uniform float iDebugMode;
 )"
 
-// Helper functions for color adjustments
-#define COLOR_HELPERS R"(
+// Helper functions for color adjustments. Effects name them with
+// COLOR_HELPERS, a line expandShaderIncludes() replaces with this one
+// copy when the sources are loaded.
+#define COLOR_HELPERS "#include \"color_helpers\""
+
+inline const char *szColorHelpers = R"(
 vec3 adjustBrightness(vec3 col, float b) {
     return col * b;
 }
@@ -107,7 +111,7 @@ vec4 mxTexture(sampler2D tex, vec2 tc) {
     return textureLod(tex, sampleUV, lod);
 }
 
-)"
+)";
 
 inline const char *srcShader1 = R"(#version 300 es
 precision highp float;
@@ -0,0 +1,163 @@
+#ifndef __THUMBNAIL_ATLAS_HPP_
+#define __THUMBNAIL_ATLAS_HPP_
+
+#include"gl.hpp"
+#include"render_target.hpp"
+#include"content_hash.hpp"
+#include<SDL2/SDL.h>
+#include<SDL2/SDL_image.h>
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdint>
+#include<cstdio>
+#include<fstream>
+#include<string>
+#include<vector>
+
+// One framebuffer holding a small preview of every effect in a grid. Cells
+// are filled a few at a time under a per-frame time budget: a cell is drawn
+// once and then left alone unless its effect is animated, in which case it
+// is refreshed in round-robin order with the others. Cell 0 is the top-left
+// cell on screen; rows grow downward, so in GL (bottom-up) coordinates it
+// sits in the last row.
+class ThumbnailAtlas {
+public:
+    // Cells shrink, keeping their aspect, when the grid would not fit in
+    // GL_MAX_TEXTURE_SIZE (WebGL2 only promises 2048).
+    bool create(size_t count, int cellW, int cellH, int cols) {
+        columns = std::max(1, cols);
+        rows = static_cast<int>((count + columns - 1) / columns);
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        double scale = 1.0;
+        if(maxSize > 0) {
+            scale = std::min({ 1.0, static_cast<double>(maxSize) / (columns * cellW), static_cast<double>(maxSize) / (std::max(1, rows) * cellH) });
+        }
+        cellWidth = std::max(1, static_cast<int>(cellW * scale));
+        cellHeight = std::max(1, static_cast<int>(cellH * scale));
+        fresh.assign(count, false);
+        cursor = 0;
+        return target.create(columns * cellWidth, std::max(1, rows) * cellHeight, false);
+    }
+
+    void release() {
+        target.release();
+        fresh.clear();
+    }
+
+    bool valid() const { return target.valid(); }
+    size_t size() const { return fresh.size(); }
+    int getCellWidth() const { return cellWidth; }
+    int getCellHeight() const { return cellHeight; }
+    int getWidth() const { return target.getWidth(); }
+    int getHeight() const { return target.getHeight(); }
+    RenderTarget &getTarget() { return target; }
+
+    void cellOrigin(size_t index, int &x, int &y) const {
+        x = static_cast<int>(index % columns) * cellWidth;
+        y = (rows - 1 - static_cast<int>(index / columns)) * cellHeight;
+    }
+
+    // Atlas pixel (GL coordinates) to cell index, or -1.
+    int cellAt(float ax, float ay) const {
+        if(ax < 0.0f || ay < 0.0f || ax >= getWidth() || ay >= getHeight()) return -1;
+        int col = static_cast<int>(ax) / cellWidth;
+        int row = rows - 1 - static_cast<int>(ay) / cellHeight;
+        size_t index = static_cast<size_t>(row) * columns + col;
+        return index < fresh.size() ? static_cast<int>(index) : -1;
+    }
+
+    void invalidate() { std::fill(fresh.begin(), fresh.end(), false); }
+
+    // Draws stale cells, and animated ones in turn, until maxCells have been
+    // drawn or budgetMs of CPU time is spent. render(index) is called with
+    // the atlas bound and the viewport set to the cell.
+    template<typename Render, typename Animated>
+    size_t update(double budgetMs, size_t maxCells, Render &&render, Animated &&animated) {
+        if(fresh.empty()) return 0;
+        auto start = std::chrono::steady_clock::now();
+        size_t drawn = 0;
+        for(size_t visited = 0; visited < fresh.size() && drawn < maxCells; ++visited) {
+            size_t index = cursor;
+            cursor = (cursor + 1) % fresh.size();
+            if(fresh[index] && !animated(index)) continue;
+            int x = 0, y = 0;
+            cellOrigin(index, x, y);
+            glViewport(x, y, cellWidth, cellHeight);
+            render(index);
+            fresh[index] = true;
+            drawn++;
+            if(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs) break;
+        }
+        return drawn;
+    }
+
+#ifndef __EMSCRIPTEN__
+    // The cache holds the atlas as a PNG (rows in GL order, bottom first)
+    // next to a text file with the key and the cells that were stored; only
+    // cells for which keep(index) is true (effects that do not animate) are
+    // written or restored.
+    template<typename Keep>
+    bool save(const std::string &filename, uint64_t key, Keep &&keep) {
+        if(!valid()) return false;
+        int w = getWidth(), h = getHeight();
+        std::vector<unsigned char> pixels(static_cast<size_t>(w) * h * 4);
+        GLint previous = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.getFramebuffer());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), w, h, 32, w * 4, SDL_PIXELFORMAT_RGBA32);
+        if(!surface) return false;
+        bool ok = IMG_SavePNG(surface, filename.c_str()) == 0;
+        SDL_FreeSurface(surface);
+        if(!ok) return false;
+        std::ofstream meta(filename + ".txt");
+        meta << std::hex << key << std::dec << " " << w << " " << h << "\n";
+        for(size_t i = 0; i < fresh.size(); ++i) {
+            if(fresh[i] && keep(i)) meta << i << "\n";
+        }
+        return meta.good();
+    }
+
+    template<typename Keep>
+    size_t load(const std::string &filename, uint64_t key, Keep &&keep) {
+        std::ifstream meta(filename + ".txt");
+        uint64_t storedKey = 0;
+        int w = 0, h = 0;
+        if(!(meta >> std::hex >> storedKey >> std::dec >> w >> h)) return 0;
+        if(storedKey != key || w != getWidth() || h != getHeight()) return 0;
+        SDL_Surface *image = IMG_Load(filename.c_str());
+        if(!image) return 0;
+        SDL_Surface *rgba = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(image);
+        if(!rgba || rgba->w != w || rgba->h != h) {
+            if(rgba) SDL_FreeSurface(rgba);
+            return 0;
+        }
+        glBindTexture(GL_TEXTURE_2D, target.getTexture());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba->pixels);
+        SDL_FreeSurface(rgba);
+        size_t restored = 0, index = 0;
+        while(meta >> index) {
+            if(index < fresh.size() && keep(index)) {
+                fresh[index] = true;
+                restored++;
+            }
+        }
+        return restored;
+    }
+#endif
+
+private:
+    RenderTarget target;
+    std::vector<bool> fresh;
+    size_t cursor = 0;
+    int cellWidth = 160, cellHeight = 90;
+    int columns = 1, rows = 0;
+};
+
+#endif
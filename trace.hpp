@@ -0,0 +1,155 @@
+#ifndef __TRACE_HPP_
+#define __TRACE_HPP_
+
+#include"bench.hpp"
+#include<atomic>
+#include<chrono>
+#include<cstdio>
+#include<cstring>
+#include<mutex>
+#include<ostream>
+#include<sstream>
+#include<string>
+#include<vector>
+
+struct TraceEvent {
+    char name[48];
+    char detail[64];
+    const char *category;
+    double ts_us;
+    double dur_us;
+    uint32_t tid;
+};
+
+// Timeline of complete ("ph":"X") events in the Chrome trace-event format,
+// loadable in about:tracing or ui.perfetto.dev. Events land in a fixed ring
+// allocated when recording starts; once full the oldest are overwritten.
+class TraceRecorder {
+public:
+    static TraceRecorder &instance() {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    void setEnabled(bool value) {
+        if(value) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(events_.size() != capacity) events_.resize(capacity);
+        }
+        enabled.store(value, std::memory_order_release);
+    }
+
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        next = 0;
+        wrapped = false;
+    }
+
+    double nowUs() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(const char *category, const char *name, const char *detail, double start_us, double dur_us) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(events_.empty()) return;
+        TraceEvent &e = events_[next];
+        copyName(e.name, sizeof(e.name), name);
+        copyName(e.detail, sizeof(e.detail), detail);
+        e.category = category;
+        e.ts_us = start_us;
+        e.dur_us = dur_us;
+        e.tid = threadId();
+        next++;
+        if(next == events_.size()) {
+            next = 0;
+            wrapped = true;
+        }
+    }
+
+    void write(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        size_t count = wrapped ? events_.size() : next;
+        size_t first = wrapped ? next : 0;
+        char buf[128];
+        for(size_t i = 0; i < count; ++i) {
+            const TraceEvent &e = events_[(first + i) % events_.size()];
+            snprintf(buf, sizeof(buf), "\"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u", e.ts_us, e.dur_us, e.tid);
+            out << "  {\"name\": \"" << jsonEscape(e.name) << "\", \"cat\": \"" << e.category << "\", " << buf;
+            if(e.detail[0] != 0) {
+                out << ", \"args\": {\"detail\": \"" << jsonEscape(e.detail) << "\"}";
+            }
+            out << "}" << (i + 1 < count ? "," : "") << "\n";
+        }
+        out << "]}\n";
+    }
+
+    std::string toJSON() {
+        std::ostringstream out;
+        write(out);
+        return out.str();
+    }
+
+private:
+    TraceRecorder() : origin(std::chrono::steady_clock::now()) {}
+
+    static void copyName(char *dst, size_t size, const char *src) {
+        if(!src) {
+            dst[0] = 0;
+            return;
+        }
+        strncpy(dst, src, size - 1);
+        dst[size - 1] = 0;
+    }
+
+    static uint32_t threadId() {
+        static std::atomic<uint32_t> counter{0};
+        thread_local uint32_t id = ++counter;
+        return id;
+    }
+
+    std::atomic<bool> enabled{false};
+    std::mutex mutex;
+    std::vector<TraceEvent> events_;
+    static constexpr size_t capacity = 32768;
+    size_t next = 0;
+    bool wrapped = false;
+    std::chrono::steady_clock::time_point origin;
+};
+
+class TraceScope {
+public:
+    TraceScope(const char *cat, const char *n, const char *d = nullptr) {
+        TraceRecorder &rec = TraceRecorder::instance();
+        if(!rec.isEnabled()) return;
+        active = true;
+        category = cat;
+        name = n;
+        detail = d;
+        start = rec.nowUs();
+    }
+    TraceScope(const char *cat, const char *n, const std::string &d) : TraceScope(cat, n, d.c_str()) {}
+    TraceScope(const char *cat, const char *n, std::string &&d) = delete;
+    ~TraceScope() {
+        if(!active) return;
+        TraceRecorder &rec = TraceRecorder::instance();
+        rec.record(category, name, detail, start, rec.nowUs() - start);
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+private:
+    bool active = false;
+    const char *category = nullptr;
+    const char *name = nullptr;
+    const char *detail = nullptr;
+    double start = 0.0;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(cat, name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(cat, name)
+#define TRACE_SCOPE_DETAIL(cat, name, detail) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(cat, name, detail)
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __UNIFORM_USAGE_HPP_
+#define __UNIFORM_USAGE_HPP_
+
+#include"gl.hpp"
+#include<cstdint>
+#include<cstring>
+#include<string>
+
+// Which groups of per-frame uniforms a linked program actually reads. The
+// GLSL compiler drops unused uniforms, so a declared-but-unused iTime does
+// not count.
+enum UniformUse : uint32_t {
+    UNIFORM_USE_NONE = 0,
+    UNIFORM_USE_TIME = 1,
+    UNIFORM_USE_MOUSE = 2,
+    UNIFORM_USE_PREV_FRAME = 4,
+    UNIFORM_USE_ALL = 7
+};
+
+inline uint32_t classifyUniform(const std::string &name) {
+    static const char *timeNames[] = { "time_f", "iTime", "iTimeDelta", "iFrame", "iSeconds", "iMinutes", "iHours", "iBeat", "iAudioLevel" };
+    static const char *mouseNames[] = { "iMouse", "iMouseNormalized", "iMouseActive", "iMouseVelocity", "iMouseClick" };
+    for(const char *n : timeNames) {
+        if(name == n) return UNIFORM_USE_TIME;
+    }
+    for(const char *n : mouseNames) {
+        if(name == n) return UNIFORM_USE_MOUSE;
+    }
+    if(name == "iPrevFrame") return UNIFORM_USE_PREV_FRAME;
+    return UNIFORM_USE_NONE;
+}
+
+inline uint32_t reflectUniformUse(GLuint program) {
+    if(program == 0) return UNIFORM_USE_ALL;
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::string name(maxLength > 0 ? maxLength : 1, '\0');
+    uint32_t use = UNIFORM_USE_NONE;
+    for(GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type, &name[0]);
+        std::string uniform(name.data(), length);
+        size_t bracket = uniform.find('[');
+        if(bracket != std::string::npos) uniform.resize(bracket);
+        use |= classifyUniform(uniform);
+    }
+    return use;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __VERTEX_QUANTIZE_HPP_
+#define __VERTEX_QUANTIZE_HPP_
+
+#include"model_data.hpp"
+#include<algorithm>
+#include<cmath>
+#include<cstdint>
+#include<cstring>
+#include<vector>
+
+// Compact vertex layout, 16 bytes instead of 32: the position as three
+// normalised shorts over the model's box (decoded with a scale and bias),
+// the normal octahedral-encoded into two normalised shorts, and the
+// texture coordinate as two half floats. sz3DVertexPacked decodes it.
+struct PackedVertex {
+    int16_t position[4];
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+inline int16_t packSnorm16(float v) {
+    v = std::max(-1.0f, std::min(1.0f, v));
+    return static_cast<int16_t>(std::lround(v * 32767.0f));
+}
+
+// Round-to-nearest float to IEEE half; overflow goes to infinity and
+// values below the half range flush to zero.
+inline uint16_t packHalf(float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    int exponent = static_cast<int>((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if(((bits >> 23) & 0xffu) == 0xffu) return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    if(exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00u);
+    if(exponent <= 0) {
+        if(exponent < -10) return sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if((mantissa >> (shift - 1)) & 1u) half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if(mantissa & 0x1000u) half++;
+    return static_cast<uint16_t>(sign | half);
+}
+
+// Octahedral normal encoding: project onto |x|+|y|+|z| = 1 and fold the
+// lower half over the diagonals.
+inline void packOctahedral(const float *n, int16_t *out) {
+    float sum = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    if(sum <= 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    float x = n[0] / sum, y = n[1] / sum;
+    if(n[2] < 0.0f) {
+        float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    out[0] = packSnorm16(x);
+    out[1] = packSnorm16(y);
+}
+
+// scale and bias map the box of the positions to [-1, 1] and back.
+inline void packVertices(const float *vertices, size_t count, const float *scale, const float *bias, std::vector<PackedVertex> &out) {
+    out.resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        const float *v = vertices + i * MeshData::STRIDE;
+        PackedVertex &p = out[i];
+        for(int k = 0; k < 3; ++k) p.position[k] = packSnorm16((v[k] - bias[k]) / scale[k]);
+        p.position[3] = 32767;
+        packOctahedral(v + 3, p.normal);
+        p.texCoord[0] = packHalf(v[6]);
+        p.texCoord[1] = packHalf(v[7]);
+    }
+}
+
+#endif